@@ -0,0 +1,45 @@
+#ifndef MDTILE__CHR_KERNELS_H
+#define MDTILE__CHR_KERNELS_H
+
+#include "types.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MDTILE_X86_KERNELS
+#endif
+
+namespace mdtile {
+
+/*
+  Low level tile primitives, working on standard (8bit) tiles
+  There is a portable scalar version of each, which serves as the reference,
+  along with SSE2 and AVX2 versions on x86. The fastest set supported by the
+  CPU is chosen at startup; use the wrappers in chr_utils.hpp rather than
+  calling these directly.
+*/
+struct ChrKernels {
+  char const* Name;
+  bool (*IsBlank)(u8 const*);
+  bool (*IsFlat)(u8 const*);
+  bool (*IsIdentical)(u8 const*, u8 const*);
+  void (*VFlip)(u8*);
+  void (*HFlip)(u8*);
+  // sum of the squared differences between two RGB tiles
+  u32 (*ColorDistance)(u8 const*, u8 const*);
+};
+
+extern ChrKernels const CHR_KERNELS_SCALAR;
+
+#ifdef MDTILE_X86_KERNELS
+extern ChrKernels const CHR_KERNELS_SSE2;
+extern ChrKernels const CHR_KERNELS_AVX2;
+#endif
+
+// returns the fastest set of kernels supported by this CPU
+ChrKernels select_chr_kernels();
+
+// the kernels in use, chosen at startup
+extern ChrKernels const chr_kernels;
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef MDTILE__CHR_UTILS_H
+#define MDTILE__CHR_UTILS_H
+
+#include "types.hpp"
+
+namespace mdtile {
+
+// standard (8bit) tiles
+bool is_blank_chr(u8 const* chr);
+
+bool is_flat_chr(u8 const* chr);
+
+bool is_identical_chr(u8 const* chr1, u8 const* chr2);
+
+void vflip_chr(u8* chr);
+
+void hflip_chr(u8* chr);
+
+// looks up each pixel of a standard (8bit) tile in palette_rgb (three bytes
+// per entry, 256 entries) to make an RGB tile of RGB_CHR_BYTESIZE bytes
+void make_rgb_chr(u8 const* chr, u8 const* palette_rgb, u8* rgb_chr);
+
+// sum of the squared differences of the red, green and blue of each pixel
+// of two RGB tiles
+u32 color_distance_chr(u8 const* rgb_chr1, u8 const* rgb_chr2);
+
+// for a standard (8bit) tile from a 64 color image, returns the palette line
+// (index / 16) of its visible pixels and leaves just the color within that
+// line in each pixel
+// color 0 of each line is transparent, so those pixels fit any line; returns
+// nothing (with the tile unchanged) if the tile uses more than one line or a
+// color past the last line
+std::optional<u8> split_palette_line(u8* chr);
+
+// packs a standard (8bit) tile down to 4bpp
+// only the low nibble of each pixel is kept, just as in the final output
+PackedChr pack_chr(u8 const* chr);
+
+// packed tiles
+bool is_identical_chr(PackedChr const& chr1, PackedChr const& chr2);
+
+void vflip_chr(PackedChr& chr);
+
+void hflip_chr(PackedChr& chr);
+
+}  // namespace mdtile
+
+#endif
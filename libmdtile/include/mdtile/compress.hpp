@@ -0,0 +1,73 @@
+#ifndef MDTILE__COMPRESS_H
+#define MDTILE__COMPRESS_H
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace mdtile {
+
+// compressed formats for output data
+enum class Compression {
+  NONE,
+  // Kosinski, as read by KosDec
+  KOSINSKI,
+  // Kosinski Moduled: a big endian word with the uncompressed size, then
+  // the data in independent 0x1000 byte modules, each a Kosinski stream
+  // padded to a multiple of 16 bytes (except the last)
+  KOSINSKI_MODULED
+};
+
+// bytes of uncompressed data in each Kosinski Moduled module
+constexpr size_t KOSM_MODULE_SIZE{0x1000};
+
+struct CompressedData {
+  std::vector<u8> Data;
+  // estimated 68000 cycles to decompress, with the stock KosDec loop (for
+  // Kosinski Moduled, the sum over every module, without the time spent
+  // queueing them)
+  size_t DecodeCycles{0};
+};
+
+// finds a compression by its name on the command line ("none", "kosinski" or
+// "kos", "kosm")
+std::optional<Compression> find_compression(std::string const& name);
+
+// the extension appended to the name of a compressed file ("" for NONE)
+char const* compression_extension(Compression method);
+
+/*
+  Compresses a block of data
+  The parse is optimal for size: every match the window allows is
+  considered and the encoding with the fewest bits is chosen, which is
+  slower than the greedy compressors in most disassembly toolkits but still
+  far faster than decompressing is on the 68000. Kosinski Moduled modules are
+  independent and are compressed in parallel on the pool, when given.
+  Throws invalid_argument for Kosinski Moduled data larger than 0xffff bytes.
+*/
+CompressedData compress(u8 const* data, size_t size, Compression method,
+                        ThreadPool* pool = nullptr);
+
+inline CompressedData compress(std::vector<u8> const& data, Compression method,
+                               ThreadPool* pool = nullptr) {
+  return compress(data.data(), data.size(), method, pool);
+}
+
+/*
+  Writes data to a file (see write_file), compressed with method, whose
+  extension is added to the path
+  The size before and after compression and the cycles to decompress are
+  added to stats, if given; with Compression::NONE the data is written as is
+  and stats is left alone.
+*/
+void write_compressed_file(std::string const& path, std::vector<u8> const& data,
+                           Compression method, ThreadPool* pool = nullptr,
+                           CompressionStats* stats = nullptr);
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MDTILE__MD_CHRGFX_H
+#define MDTILE__MD_CHRGFX_H
+
+/*
+  chrgfx definitions for the Mega Drive formats
+  libmdtile itself does not depend on chrgfx; this header is for programs
+  that use chrgfx to load images (png_chunk) or convert palettes
+*/
+
+#include <chrgfx/chrgfx.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mdtile {
+
+chrgfx::chrdef const MD_CHR{
+    "Megadrive",
+    8,
+    8,
+    4,
+    std::vector<std::uint32_t>{3, 2, 1, 0},
+    std::vector<std::uint32_t>{0, 4, 8, 12, 16, 20, 24, 28},
+    std::vector<std::uint32_t>{0, 32, 64, 96, 128, 160, 192, 224}};
+
+chrgfx::paldef const MD_PAL{"Megadrive", 16, 16, 4};
+chrgfx::coldef const MD_COL{
+    "Megadrive", 3,
+    std::vector<chrgfx::rgb_layout>{chrgfx::rgb_layout{
+        std::pair{1, 3}, std::pair{5, 3}, std::pair{9, 3}}},
+    true};
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MDTILE__MD_GFX_H
+#define MDTILE__MD_GFX_H
+
+#include <string>
+#include <vector>
+
+#include "compress.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace mdtile {
+
+/*
+  Converts a standard (8bit) tile to Mega Drive format, two pixels per byte
+  with the leftmost pixel in the high nibble
+  This produces the same output as chrgfx::conv_chr::cvto_chr(MD_CHR, ...),
+  but without the generic bit-by-bit conversion or an allocation per tile
+*/
+void pack_md_chr(u8 const* in_chr, u8* out_chr);
+
+// converts a list of standard tiles into one contiguous buffer of Mega Drive
+// format tiles
+std::vector<u8> pack_md_chr_list(std::vector<u8*> const& tiles);
+
+// writes a list of standard tiles to a file in Mega Drive format, in one go,
+// compressed if a method is given (see write_compressed_file)
+void write_md_chr_file(std::string const& path, std::vector<u8*> const& tiles,
+                       Compression method = Compression::NONE,
+                       ThreadPool* pool = nullptr,
+                       CompressionStats* stats = nullptr);
+
+}  // namespace mdtile
+
+#endif
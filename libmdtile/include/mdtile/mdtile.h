@@ -0,0 +1,126 @@
+#ifndef MDTILE__MDTILE_H
+#define MDTILE__MDTILE_H
+
+/*
+  libmdtile C API
+  Converts 8bpp indexed images to Mega Drive tiles and tilemaps in process.
+  All input buffers are owned by the caller and are only read. Output is
+  returned in an mdtile_result, which owns its buffers until it is freed.
+  Functions that can fail return MDTILE_OK (0) on success or an error code;
+  mdtile_error_string describes the error.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MDTILE_CHR_BYTESIZE 64
+#define MDTILE_MD_CHR_BYTESIZE 32
+
+enum mdtile_status {
+  MDTILE_OK = 0,
+  MDTILE_ERR_INVALID_ARGUMENT = 1,
+  MDTILE_ERR_OUT_OF_MEMORY = 2,
+  MDTILE_ERR_INTERNAL = 3
+};
+
+enum mdtile_tile_type {
+  MDTILE_TILE_BLANK = 1,
+  MDTILE_TILE_FLAT = 2,
+  MDTILE_TILE_NORMAL = 3
+};
+
+enum mdtile_tile_order {
+  /* flats first, then normal tiles, in source order */
+  MDTILE_ORDER_SOURCE = 0,
+  /* by first use, a row of the map at a time */
+  MDTILE_ORDER_ROW = 1,
+  /* by first use, a column of the map at a time */
+  MDTILE_ORDER_COLUMN = 2
+};
+
+struct mdtile_options {
+  /* added to each tile index in the tilemap */
+  uint16_t base;
+  /* non-zero to write one tilemap entry per tile, without any runs */
+  int no_map_optimize;
+  /* how the output tiles are numbered, one of mdtile_tile_order */
+  int tile_order;
+  /*
+    lossy merging of near duplicate tiles, off unless max_tiles or max_error
+    is set: merge down to max_tiles unique tiles (0 for no limit) without
+    any tile differing by more than max_error as the RMS color distance per
+    pixel (0 for no limit), comparing colors from the palette (palette_size
+    entries of red, green and blue bytes)
+  */
+  size_t max_tiles;
+  double max_error;
+  uint8_t const* palette;
+  size_t palette_size;
+  /*
+    split the map into chunks of chunk_width by chunk_height tiles (at most
+    2048 tiles each), returning the chunk index in place of the tilemap; 0
+    for a single tilemap
+  */
+  size_t chunk_width;
+  size_t chunk_height;
+  /*
+    non-zero if the image uses all four palette lines (64 colors): each tile
+    takes its line from its colors, tiles that differ only in their line are
+    dupes, and the tilemap sets the line with palette line entries, which
+    need the load_tilemap in tilemap.s that understands them
+  */
+  int palette_lines;
+  /* worker threads to use, including the calling thread; 0 or 1 for none */
+  unsigned int threads;
+};
+
+typedef struct mdtile_result mdtile_result;
+
+char const* mdtile_error_string(int status);
+
+/* tile primitives, on one standard (8bpp, 64 byte) tile */
+enum mdtile_tile_type mdtile_classify_chr(uint8_t const* chr);
+
+/* packs a standard tile to a 32 byte Mega Drive tile */
+void mdtile_pack_md_chr(uint8_t const* in_chr, uint8_t* out_chr);
+
+/*
+  Converts an 8bpp indexed image, pitch bytes per row, to tiles and a
+  tilemap; partial tiles at the right or bottom edge are dropped
+  opts may be NULL for the defaults
+*/
+int mdtile_convert_indexed(uint8_t const* pixels, size_t width, size_t height,
+                           size_t pitch, struct mdtile_options const* opts,
+                           mdtile_result** result);
+
+/*
+  As above, for tiles that are already cut and stored back to back in
+  standard format; width_chr is the width of the tilemap in tiles
+*/
+int mdtile_convert_tiles(uint8_t const* tiles, size_t count, size_t width_chr,
+                         struct mdtile_options const* opts,
+                         mdtile_result** result);
+
+size_t mdtile_result_input_tiles(mdtile_result const* result);
+size_t mdtile_result_output_tiles(mdtile_result const* result);
+
+/* contents of the .chr file: output_tiles Mega Drive format tiles */
+uint8_t const* mdtile_result_chr(mdtile_result const* result, size_t* size);
+
+/*
+  contents of the .map file: the big endian tilemap list, or the chunk index
+  (.chk file) when chunk_width and chunk_height are set
+*/
+uint8_t const* mdtile_result_map(mdtile_result const* result, size_t* size);
+
+void mdtile_result_free(mdtile_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef MDTILE__MERGE_H
+#define MDTILE__MERGE_H
+
+#include <optional>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace mdtile {
+
+// settings for merging near duplicate tiles
+struct TileMergeOptions {
+  // merge until there are no more than this many unique tiles
+  std::optional<size_t> MaxTiles{std::nullopt};
+  // never replace a tile with one that differs from it by more than this,
+  // as the RMS color distance per pixel (0 to about 441)
+  std::optional<double> MaxError{std::nullopt};
+  // the red, green and blue of each palette entry, three bytes per entry
+  // (entries past the end are black); with palette lines, all four lines
+  std::vector<u8> Palette;
+
+  bool enabled() const { return MaxTiles || MaxError; }
+};
+
+// what merging did to the tiles
+struct TileMergeResult {
+  size_t TilesBefore{0};
+  size_t TilesAfter{0};
+  // the squared color distance (see color_distance_chr) summed over every
+  // tile in the map that was replaced, and the number of those tiles
+  uint64_t ErrorSum{0};
+  size_t ChangedTiles{0};
+  // the largest squared color distance of any one replaced tile
+  u32 MaxError{0};
+};
+
+// converts a squared color distance summed over count tiles to the RMS color
+// distance per pixel
+double rms_color_error(uint64_t error_sum, size_t count);
+
+/*
+  Lossy tile reduction
+  Finds the unique tiles that look most alike under all four flips and
+  merges them, each group of tiles becoming one tile, until the tile budget
+  is met or no more tiles can be merged within the error limit.
+  Tiles are compared by the squared distance between the palette colors of
+  each pixel. Candidate pairs come from an approximate nearest neighbour
+  search, which sorts the tiles by the coarse colors of a few sampled pixels
+  and compares each only to those around it, so the work grows with the
+  number of tiles rather than its square.
+  With palette lines, a replaced tile is drawn with the pixels of the tile
+  it was merged into in every line it is used with, so its error is the
+  worst over those lines.
+  Call this on the tiles from optimize_tiles, before any reordering.
+  The cells of replaced tiles show the tile they were merged into, with the
+  flips needed to match, and the remaining unique tiles keep their order.
+*/
+TileMergeResult merge_tiles(TileOptMap& opt_tiles,
+                            TileMergeOptions const& opts,
+                            ThreadPool* pool = nullptr);
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef MDTILE__OUTPUT_H
+#define MDTILE__OUTPUT_H
+
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+namespace mdtile {
+
+/*
+  Output files
+  Everything the tools write is built up in memory as big endian data and
+  written with write_file, which puts the whole buffer in a temporary file
+  beside the destination with one write and renames it into place. Builds
+  running in parallel (or reading the files while they are being written)
+  then only ever see complete files.
+*/
+
+// appends words in big endian order, swapping them as a block on little
+// endian hosts
+void put_words_be(std::vector<u8>& out, u16 const* words, size_t count);
+
+inline void put_words_be(std::vector<u8>& out, std::vector<u16> const& words) {
+  put_words_be(out, words.data(), words.size());
+}
+
+inline void put_word_be(std::vector<u8>& out, u16 word) {
+  out.push_back((u8)(word >> 8));
+  out.push_back((u8)word);
+}
+
+inline void put_long_be(std::vector<u8>& out, u32 value) {
+  put_word_be(out, (u16)(value >> 16));
+  put_word_be(out, (u16)value);
+}
+
+// writes a buffer to a file, replacing it atomically
+// throws runtime_error if the file cannot be written
+void write_file(std::string const& path, u8 const* data, size_t size);
+
+inline void write_file(std::string const& path, std::vector<u8> const& data) {
+  write_file(path, data.data(), data.size());
+}
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef MDTILE__STATS_H
+#define MDTILE__STATS_H
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+namespace mdtile {
+
+// the size of one output file before and after compression, and the
+// estimated cycles to decompress it
+struct CompressionStats {
+  size_t Bytes{0};
+  size_t CompressedBytes{0};
+  size_t DecodeCycles{0};
+};
+
+/*
+  Timing and deduplication statistics for a conversion
+*/
+struct TileOptStats {
+  // wall time per phase, in milliseconds
+  // when streaming, decode includes cutting the strips into tiles (the chunk
+  // phase) and excludes the classify/dedup work done as each strip arrives
+  double DecodeMs{0};
+  double ChunkMs{0};
+  double ClassifyMs{0};
+  double DedupMs{0};
+  double ReorderMs{0};
+  double MergeMs{0};
+  double MapEncodeMs{0};
+  double CompressMs{0};
+  double WriteMs{0};
+
+  size_t BlankTiles{0};
+  size_t FlatTiles{0};
+  size_t NormalTiles{0};
+  // flat tiles that repeat an earlier flat of the same color
+  size_t FlatDupes{0};
+  // normal tiles that repeat an earlier tile, by the flip needed to match it
+  size_t ExactDupes{0};
+  size_t HFlipDupes{0};
+  size_t VFlipDupes{0};
+  size_t HVFlipDupes{0};
+  size_t UniqueTiles{0};
+
+  // number of tilemap entries by run length
+  std::map<size_t, size_t> TileRuns;
+  std::map<size_t, size_t> BlankRuns;
+
+  // size of the tilemap in words and estimated cycles for load_tilemap
+  size_t MapWords{0};
+  size_t MapCycles{0};
+  // with verification, the cycles the simulated load_tilemap and
+  // clear_tilemap took (otherwise 0)
+  size_t SimMapCycles{0};
+  size_t SimClearCycles{0};
+
+  // tiles removed by lossy merging, the squared color distance summed over
+  // the replaced tiles in the map, the number of those tiles and the largest
+  // distance of any one of them (see TileMergeResult)
+  size_t MergedTiles{0};
+  uint64_t MergeErrorSum{0};
+  size_t MergeChangedTiles{0};
+  u32 MergeMaxError{0};
+
+  // bytes of new tiles to transfer for each strip of the map, in scrolling
+  // order, with a first use tile order (otherwise empty)
+  std::vector<size_t> StripDmaBytes;
+
+  // the tiles and the tilemap (or chunk index), with compressed output
+  // (otherwise all 0)
+  CompressionStats ChrCompression;
+  CompressionStats MapCompression;
+};
+
+// adds the time since start to the total, in milliseconds
+void add_elapsed(double& total_ms,
+                 std::chrono::steady_clock::time_point const& start);
+
+// counts a tile by type, and a dupe by the flip needed to match
+// (call once the tile has been deduplicated)
+void count_tile(TileOptMeta const& tile, TileOptStats& stats);
+
+// builds the run length histograms from an optimized tilemap
+void count_runs(std::vector<TilemapEntry> const& tilemap, TileOptStats& stats);
+
+// adds the stats of compressing one file to a running total
+void add_compression(CompressionStats& total, CompressionStats const& stats);
+
+// describes the stats of compressing a file, as the size before and after,
+// the ratio and the cycles to decompress
+std::string describe_compression(CompressionStats const& stats);
+
+// adds the stats of one conversion to a running total
+void add_stats(TileOptStats& total, TileOptStats const& stats);
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef MDTILE__THREAD_POOL_H
+#define MDTILE__THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mdtile {
+
+/*
+  A fixed pool of worker threads with work stealing
+  Each worker has its own task queue: tasks queued from a worker go onto that
+  worker's queue and are run newest first, while idle workers steal the oldest
+  tasks from everyone else. Threads outside the pool share one extra queue.
+  Any thread waiting on a TaskGroup runs queued tasks until the group is done,
+  so tasks may themselves queue and wait on more tasks (e.g. a batch job that
+  uses parallel_for) without tying up the pool. A pool of size 1 has no
+  workers and runs everything on the waiting thread.
+*/
+class ThreadPool {
+ public:
+  // a set of tasks that can be waited on together
+  class TaskGroup {
+    friend class ThreadPool;
+
+    std::atomic<size_t> m_pending{0};
+    std::mutex m_error_mutex;
+    std::exception_ptr m_error;
+  };
+
+  explicit ThreadPool(unsigned int thread_count = 1);
+
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  // total threads, including the calling thread
+  unsigned int size() const { return m_workers.size() + 1; }
+
+  // queues a task as part of a group
+  void run(TaskGroup& group, std::function<void()> task);
+
+  // runs queued tasks until every task in the group has finished
+  // rethrows the first exception thrown by a task in the group
+  void wait(TaskGroup& group);
+
+  // splits [0, count) into chunks of at most chunk_size, calls
+  // work(begin, end) for each chunk across the pool and waits for all of them
+  // to finish
+  void parallel_for(size_t count, size_t chunk_size,
+                    std::function<void(size_t, size_t)> const& work);
+
+ private:
+  struct WorkQueue {
+    std::mutex Mutex;
+    std::deque<std::function<void()>> Tasks;
+  };
+
+  // queue used by the current thread: its own if it is one of our workers,
+  // otherwise the shared queue 0
+  size_t home_queue() const { return tl_pool == this ? tl_queue : 0; }
+
+  // takes the newest task from our own queue, or failing that, steals the
+  // oldest task from another queue
+  bool pop_task(std::function<void()>& task);
+
+  void notify();
+
+  void worker_loop(size_t queue_idx);
+
+  std::vector<std::unique_ptr<WorkQueue>> m_queues;
+  std::vector<std::thread> m_workers;
+  std::atomic<size_t> m_queued{0};
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_wake;
+  bool m_stop{false};
+
+  static thread_local ThreadPool* tl_pool;
+  static thread_local size_t tl_queue;
+};
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MDTILE__TILEMAP_H
+#define MDTILE__TILEMAP_H
+
+#include <vector>
+
+#include "types.hpp"
+
+namespace mdtile {
+
+// longest tile run, as there are only three bits for the run length
+size_t const MAX_TILE_RUN{7};
+// longest blank run, as load_tilemap only reads the lower 11 bits
+size_t const MAX_BLANK_RUN{0x7ff};
+
+// an entry that sets the palette line (in the low two bits) for the entries
+// after it, in maps made with palette lines
+// blank runs never set bit 12, as their count is only 11 bits
+u16 const PALETTE_LINE_ENTRY{0x3000};
+
+// the size of an encoded tilemap and the estimated cost to load it
+struct TilemapCost {
+  // words in the .map file, including the width and the terminator
+  size_t Words{0};
+  // estimated 68000 cycles spent in load_tilemap (tilemap.s)
+  size_t Cycles{0};
+};
+
+/*
+  Works out the size of a tilemap and the cycles load_tilemap spends drawing
+  it, from the 68000 instruction timings of each path through the routine
+  width_chr is the width of the map in tiles; palette_lines counts the
+  palette line entries make_tilemap_list adds for maps made with palette
+  lines
+  VDP wait states are not counted, so this is a lower bound; it is meant for
+  comparing encodings of the same map
+*/
+TilemapCost tilemap_cost(std::vector<TilemapEntry> const& tilemap,
+                         size_t width_chr, bool palette_lines = false);
+
+// the number of palette line entries make_tilemap_list adds to the tilemap:
+// one before the first tile and one wherever the line changes
+size_t palette_line_entries(std::vector<TilemapEntry> const& tilemap);
+
+}  // namespace mdtile
+
+#endif
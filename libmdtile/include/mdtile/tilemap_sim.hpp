@@ -0,0 +1,50 @@
+#ifndef MDTILE__TILEMAP_SIM_H
+#define MDTILE__TILEMAP_SIM_H
+
+#include <vector>
+
+#include "types.hpp"
+
+namespace mdtile {
+
+// what load_tilemap or clear_tilemap did with a tilemap
+struct TilemapSimResult {
+  // the nametable entries written, in order: row by row, each row as wide as
+  // the width given in the tilemap
+  std::vector<u16> Cells;
+  // words read from the tilemap, including the width and the terminator
+  size_t Words{0};
+  // 68000 cycles from the first instruction to the return, not counting the
+  // call
+  size_t Cycles{0};
+};
+
+/*
+  Runs load_tilemap from tilemap.s on the host
+  tilemap is the list of words, as from make_tilemap_list, and settings is
+  what would be passed in D2 (see TILEMAP_SETTINGS in tilemap.h). Each path
+  through the routine is followed as the 68000 would, with the same register
+  widths (so a blank run of 0 draws 65536 blanks, and the base tile is added
+  to the whole entry), and its cycles are counted instruction by
+  instruction.
+  If vram is given (0x8000 words), the entries are also written to it as the
+  VDP would, starting each row at the nametable offset (D0) plus the rows
+  drawn so far times tiles_per_row (D1), with the address wrapping at 64 KiB.
+  This assumes an auto increment of 2 and an even offset.
+  Throws runtime_error if the tilemap runs out before its terminator.
+*/
+TilemapSimResult simulate_load_tilemap(std::vector<u16> const& tilemap,
+                                       u32 settings = 0, u16* vram = nullptr,
+                                       u16 nametable_offset = 0,
+                                       u8 tiles_per_row = 64);
+
+// as above, for clear_tilemap, which writes 0 to every cell the tilemap
+// covers
+TilemapSimResult simulate_clear_tilemap(std::vector<u16> const& tilemap,
+                                        u16* vram = nullptr,
+                                        u16 nametable_offset = 0,
+                                        u8 tiles_per_row = 64);
+
+}  // namespace mdtile
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef MDTILE__TILEOPT_H
+#define MDTILE__TILEOPT_H
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "merge.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "tilemap.hpp"
+#include "types.hpp"
+
+namespace mdtile {
+
+// identifies a tile as blank, flat or normal and packs normal tiles
+TileOptMeta classify_tile(u8* tile_data, size_t orig_idx);
+
+/*
+  Marks tiles for optimization
+  Tiles are fed in, in source order, in as many batches as needed (e.g. one
+  strip of an image at a time), and are classified and deduplicated as they
+  arrive. Once all tiles have been added, finish() assigns the final tile
+  indices and returns the unique tiles and the cells of the map.
+  Only the unique tiles keep their meta data (and an entry in the dedup
+  index); every other tile is kept as just its TileCell, 8 bytes a tile.
+  If keep_tile_data is set, the data of each unique tile is copied and the
+  meta data points to that copy, so the source tiles may be discarded as
+  soon as add_tiles returns.
+  Tile data is only ever read, never modified.
+*/
+class TileOptimizer {
+ public:
+  explicit TileOptimizer(ThreadPool* pool = nullptr,
+                         bool keep_tile_data = false,
+                         TileOptStats* stats = nullptr)
+      : m_pool{pool}, m_keep_tile_data{keep_tile_data}, m_stats{stats} {}
+
+  void reserve(size_t tile_count);
+
+  // lines, if given, is the palette line of each tile, from
+  // split_palette_lines
+  void add_tiles(u8* const* tiles, size_t count, u8 const* lines = nullptr);
+
+  TileOptMap finish();
+
+  // hands over the copies of the unique tiles (if keep_tile_data was set)
+  // these must outlive the tiles returned by finish()
+  TileStore release_tile_store() { return std::move(m_tile_store); }
+
+ private:
+  void find_dupe(TileOptMeta& work_tile, TileCell& cell);
+
+  std::optional<size_t> find_normal(PackedChr const& chr) const;
+
+  void mark_dupe(TileOptMeta& work_tile, TileCell& cell, size_t dupe_idx);
+
+  void add_unique(TileOptMeta& work_tile, TileCell& cell);
+
+  void keep_data(TileOptMeta& work_tile);
+
+  ThreadPool* m_pool;
+  bool m_keep_tile_data;
+  TileOptStats* m_stats;
+
+  // the unique tiles, in the order they were found, and the cell of every
+  // tile added so far; until finish(), the OptIdx of a cell is the index of
+  // its tile in m_tiles
+  std::vector<TileOptMeta> m_tiles;
+  std::vector<TileCell> m_cells;
+  // the batch being added
+  std::vector<TileOptMeta> m_batch;
+  // unique tiles by content (normal tiles) or color (flat tiles), as indices
+  // into m_tiles
+  std::unordered_map<PackedChr, size_t, PackedChrHash> m_normal_index;
+  std::optional<size_t> m_flat_index[256];
+  PackedChr m_flip_work;
+
+  // copies of the unique tiles, if we are keeping them
+  TileStore m_tile_store;
+};
+
+// marks a complete set of tiles for optimization
+TileOptMap optimize_tiles(std::vector<u8*> const& src_tiles,
+                          ThreadPool* pool = nullptr,
+                          TileOptStats* stats = nullptr);
+
+// as above, for count tiles stored back to back (CHR_BYTESIZE bytes each)
+// the meta data points into the caller's buffer
+TileOptMap optimize_tiles(u8 const* src_tiles, size_t count,
+                          ThreadPool* pool = nullptr,
+                          TileOptStats* stats = nullptr);
+
+/*
+  For images drawn with all four palette lines (64 colors)
+  Splits each tile into its palette line, which is appended to lines, and its
+  colors within the line, which are left in the tile, so that tiles which
+  differ only in their line are found to be dupes.
+  Throws std::invalid_argument if a tile uses more than one line, naming it
+  by its index in the image, where first_idx is that of the first tile
+*/
+void split_palette_lines(u8* const* tiles, size_t count,
+                         std::vector<u8>& lines, size_t first_idx = 0);
+
+// sets the palette line of each cell, in source order, from
+// split_palette_lines
+void set_palette_lines(TileOptMap& tiles, std::vector<u8> const& lines);
+
+// create final list of tiles to be exported
+std::vector<u8*> make_tile_list(TileOptMap const& tiles);
+
+// how the unique tiles are numbered in the output
+enum class TileOrder {
+  // flats first, then normal tiles, in source order
+  SOURCE,
+  // by first use, a row of the map at a time (for vertical scrolling)
+  ROW,
+  // by first use, a column of the map at a time (for horizontal scrolling)
+  COLUMN
+};
+
+/*
+  Renumbers the unique tiles in the order a scrolling engine first needs
+  them, walking the map a row or column (strip) at a time, so that the tiles
+  each strip adds are one contiguous range
+  width_chr is the width of the map in tiles
+  Returns the number of new tiles in each strip; nothing is changed for
+  TileOrder::SOURCE
+*/
+std::vector<size_t> order_tiles(TileOptMap& tiles, size_t width_chr,
+                                TileOrder order);
+
+// encodes the tilemap greedily, taking the longest run possible at each tile
+std::vector<TilemapEntry> optimize_tilemap(std::vector<TileCell> const& cells,
+                                           bool no_optimize = false);
+
+/*
+  Converts the tilemap to the final list of words: the width, the entries
+  and the terminator
+  With palette_lines, a palette line entry (PALETTE_LINE_ENTRY) comes before
+  the first tile and wherever the palette line changes; these need the
+  load_tilemap in tilemap.s that understands them.
+*/
+std::vector<u16> make_tilemap_list(
+    std::vector<TilemapEntry> const& tilemap_list, u16 tile_base, u16 width,
+    bool palette_lines = false);
+
+// settings for building a tileset from tile meta data
+struct TilesetOptions {
+  // added to each tile index in the tilemap
+  u16 Base{0};
+  // write one tilemap entry per tile, without any runs
+  bool NoMapOptimize{false};
+  TileOrder Order{TileOrder::SOURCE};
+  // lossy merging of near duplicate tiles, if enabled
+  TileMergeOptions Merge;
+  // if set, split the map into chunks of this many tiles across and down,
+  // with a chunk index in place of the single tilemap
+  size_t ChunkWidth{0};
+  size_t ChunkHeight{0};
+  // the tiles have palette lines (see split_palette_lines), which are set in
+  // the tilemap with palette line entries
+  bool PaletteLines{false};
+  // draw each tilemap with the simulated load_tilemap and clear_tilemap (see
+  // tilemap_sim.hpp) and check that every cell shows its tile, throwing
+  // runtime_error if not
+  bool Verify{false};
+
+  bool chunked() const { return ChunkWidth > 0 && ChunkHeight > 0; }
+};
+
+// most tiles a chunk may cover, so that its local tile indices always fit
+// in the 11 bits of a tilemap entry
+size_t const MAX_CHUNK_TILES{0x800};
+
+// the contents of the .chr and .map (or .chk) files for one image
+struct Tileset {
+  size_t InputTiles{0};
+  size_t OutputTiles{0};
+  // Mega Drive format tiles
+  std::vector<u8> Chr;
+  // the tilemap list, as big endian words, or the chunk index when the map
+  // is split into chunks
+  std::vector<u8> Map;
+};
+
+/*
+  Splits the map into chunks and builds the chunk index, for levels too large
+  to fit in VRAM at once
+  Tiles are deduplicated across the whole image into one tile set, and each
+  chunk lists the tiles it uses so that an engine can load just the chunks
+  near the camera. Chunks at the right and bottom edges may be smaller.
+  The chunk index is all big endian:
+    word   chunk width, in tiles
+    word   chunk height, in tiles
+    word   chunks across
+    word   chunks down
+    long   offset of each chunk from the start of the index, a row of
+           chunks at a time
+  then for each chunk:
+    word   number of tiles the chunk uses
+    word   index of each of those tiles in the tile set, in ascending order;
+           the position of a tile in this list is its index in the chunk
+    the tilemap list of the chunk, as in a .map file, using the indices in
+    the chunk (plus the tile base)
+  Throws std::invalid_argument if a chunk is larger than MAX_CHUNK_TILES and
+  std::runtime_error if there are more tiles than a word can index.
+*/
+std::vector<u8> make_chunk_index(TileOptMap const& tiles, size_t width_chr,
+                                 TilesetOptions const& opts,
+                                 TileOptStats* stats = nullptr);
+
+/*
+  Builds the final tiles and the tilemap from optimized tiles
+  width_chr is the width of the image in tiles; merging and reordering work
+  on the tiles passed in, so move them in if they are not needed after
+  If stats is given, the map encode time, run histograms and map cost are
+  added to it, along with the DMA cost of each strip for a first use tile
+  order and the merge results when merging
+  If the options ask for chunks, Map holds the chunk index (see
+  make_chunk_index)
+*/
+Tileset make_tileset(TileOptMap tiles, size_t width_chr,
+                     TilesetOptions const& opts, ThreadPool* pool = nullptr,
+                     TileOptStats* stats = nullptr);
+
+/*
+  Cuts an 8bpp indexed image into tiles, stored back to back in standard
+  format, left to right and top to bottom
+  pitch is the distance between rows in bytes; any partial tiles at the right
+  or bottom edge are dropped, as with chrgfx::png_chunk
+*/
+std::vector<u8> chunk_indexed_image(u8 const* pixels, size_t width,
+                                    size_t height, size_t pitch);
+
+/*
+  Converts an 8bpp indexed image straight to a tileset
+  The pixels are read from the caller's buffer and are not modified
+  With PaletteLines set, the image may use all 64 colors
+*/
+Tileset convert_indexed_image(u8 const* pixels, size_t width, size_t height,
+                              size_t pitch, TilesetOptions const& opts,
+                              ThreadPool* pool = nullptr,
+                              TileOptStats* stats = nullptr);
+
+}  // namespace mdtile
+
+#endif
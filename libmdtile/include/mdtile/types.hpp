@@ -0,0 +1,139 @@
+#ifndef MDTILE__TYPES_H
+#define MDTILE__TYPES_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace mdtile {
+
+typedef std::uint8_t u8;
+typedef std::uint16_t u16;
+typedef std::uint32_t u32;
+
+// tiles are worked on in "standard" (8bit) format, one byte per pixel, row
+// by row; this is the same layout chrgfx::png_chunk produces
+size_t const CHR_WIDTH{8};
+size_t const CHR_HEIGHT{8};
+size_t const CHR_BYTESIZE{CHR_WIDTH * CHR_HEIGHT};
+
+// the Mega Drive has four palette lines of 16 colors each
+size_t const PALETTE_LINES{4};
+size_t const PALETTE_LINE_COLORS{16};
+
+// size of a tile in the final, Mega Drive (4bpp) format
+size_t const MD_CHR_BYTESIZE{CHR_BYTESIZE / 2};
+
+// size of a tile with each pixel looked up in the palette, stored as planes
+// of red, green and blue (CHR_BYTESIZE bytes each)
+size_t const RGB_CHR_BYTESIZE{CHR_BYTESIZE * 3};
+
+// owned tile buffers, CHR_BYTESIZE bytes each
+typedef std::vector<std::unique_ptr<u8[]>> TileStore;
+
+enum TileType { UNDEFINED, BLANK, FLAT, NORMAL };
+
+// a tile packed into the Mega Drive 4bpp layout, one 32 bit word per row
+// with the leftmost pixel in the high nibble
+// (this also serves as an exact key for the tile's content)
+struct PackedChr {
+  std::array<u32, 8> Rows{};
+
+  bool operator==(PackedChr const& other) const { return Rows == other.Rows; }
+};
+
+struct PackedChrHash {
+  size_t operator()(PackedChr const& chr) const {
+    uint64_t hash{0};
+    for (auto const this_row : chr.Rows) {
+      hash = (hash ^ this_row) * 0x9e3779b97f4a7c15;
+      hash ^= hash >> 29;
+    }
+    return (size_t)hash;
+  }
+};
+
+// describes a tilemap entry
+struct TilemapEntry {
+  // if not set, blank (null) tile
+  std::optional<u32> TileID{std::nullopt};
+  // number of entries; if not set, single tile
+  std::optional<u16> RunLength{std::nullopt};
+
+  bool HFlip{false};
+  bool VFlip{false};
+  // palette line (0 to 3), for maps made with palette lines
+  u8 PaletteLine{0};
+};
+
+// tile optimization meta data
+struct TileOptMeta {
+  // index of this tile in the original image
+  size_t OrigIdx{0};
+
+  // index of this tile in the final, optimized tile block
+  std::optional<size_t> OptIdx{std::nullopt};
+
+  TileType Type{TileType::UNDEFINED};
+
+  // if this tile is duplicated elsewhere, this is the OrigIdx of that tile
+  // (should use the DupeIdx if available)
+  std::optional<size_t> DupeIdx{std::nullopt};
+
+  bool HasDupe{false};
+
+  // tile is blank (all palette entry 0, invisible)
+  bool IsNull{false};
+
+  // tile is all one color, with no variation
+  bool IsFlat{false};
+  // if the tile is flat, use this pal entry (offset of palette line)
+  u8 FlatPalEntry{0};
+  // indicates this tile data needs to be v/h flipped in order to match the
+  // dupe
+  bool DupeVFlip{false};
+  bool DupeHFlip{false};
+
+  // the palette line (0 to 3) the tile is drawn with, when the image uses
+  // all four lines; tiles that differ only in their line are dupes
+  u8 PaletteLine{0};
+
+  // packed (natural) tile data, used for comparison
+  PackedChr Packed;
+
+  // the tile data in standard (8bit) format
+  u8* DataPtr{nullptr};
+};
+
+// the OptIdx of a blank cell
+u32 const BLANK_CELL{0xffffffff};
+
+// a cell of the map: the unique tile it shows and how it is drawn
+// this is all that is kept of each tile once it has been deduplicated
+struct TileCell {
+  // index of the tile in the final, optimized tile block, or BLANK_CELL
+  u32 OptIdx{BLANK_CELL};
+  // the flips needed to draw the unique tile as this one
+  bool HFlip{false};
+  bool VFlip{false};
+  // the palette line (0 to 3) the cell is drawn with
+  u8 PaletteLine{0};
+
+  bool blank() const { return OptIdx == BLANK_CELL; }
+};
+
+// optimized tiles: each unique tile once, and every cell of the map
+struct TileOptMap {
+  // the unique tiles, in the order of the final tile block (so the OptIdx of
+  // each is its position here)
+  std::vector<TileOptMeta> Tiles;
+  // every cell of the map, in source order
+  std::vector<TileCell> Cells;
+};
+
+}  // namespace mdtile
+
+#endif
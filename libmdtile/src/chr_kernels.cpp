@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <utility>
+
+#include <mdtile/chr_kernels.hpp>
+
+#ifdef MDTILE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace mdtile {
+
+// the kernels themselves are only reachable through the tables below
+// (the vector versions assume a 64 byte tile, which is always the case for
+// the Mega Drive)
+namespace {
+
+/*
+  Scalar
+*/
+bool is_blank_chr_scalar(u8 const* chr) {
+  for (u8 pixel_iter{0}; pixel_iter < CHR_BYTESIZE; ++pixel_iter) {
+    if (chr[pixel_iter] != 0) return false;
+  }
+  return true;
+}
+
+bool is_flat_chr_scalar(u8 const* chr) {
+  u8 flatval = *chr;
+  for (u8 pixel_iter{1}; pixel_iter < CHR_BYTESIZE; ++pixel_iter) {
+    if (chr[pixel_iter] != flatval) return false;
+  }
+  return true;
+}
+
+bool is_identical_chr_scalar(u8 const* chr1, u8 const* chr2) {
+  for (u8 pixel_iter{0}; pixel_iter < CHR_BYTESIZE; ++pixel_iter) {
+    if (chr1[pixel_iter] != chr2[pixel_iter]) return false;
+  }
+  return true;
+}
+
+void vflip_chr_scalar(u8* chr) {
+  int const swapcount{(int)CHR_HEIGHT / 2};
+  u8* row1_offset{nullptr};
+  u8* row2_offset{nullptr};
+
+  for (u8 this_rowswap{0}; this_rowswap < swapcount; ++this_rowswap) {
+    row1_offset = chr + (this_rowswap * CHR_WIDTH);
+    row2_offset = chr + ((7 - this_rowswap) * CHR_WIDTH);
+    std::swap_ranges(row1_offset, row1_offset + CHR_WIDTH, row2_offset);
+  }
+}
+
+void hflip_chr_scalar(u8* chr) {
+  int const swapcount{(int)CHR_WIDTH / 2};
+  size_t pxl1_offset{0};
+  size_t pxl2_offset{0};
+  // two loops, one for each row
+  // inner loop for each pixel swap in that row
+  for (u8 this_row{0}; this_row < CHR_HEIGHT; ++this_row) {
+    for (u8 this_pxlswap{0}; this_pxlswap < swapcount; ++this_pxlswap) {
+      pxl1_offset = (this_row * CHR_WIDTH) + this_pxlswap;
+      pxl2_offset = (this_row * CHR_WIDTH) + (7 - this_pxlswap);
+      std::swap(chr[pxl1_offset], chr[pxl2_offset]);
+    }
+  }
+}
+
+u32 color_distance_chr_scalar(u8 const* rgb_chr1, u8 const* rgb_chr2) {
+  u32 distance{0};
+  for (size_t this_byte{0}; this_byte < RGB_CHR_BYTESIZE; ++this_byte) {
+    int const diff{(int)rgb_chr1[this_byte] - (int)rgb_chr2[this_byte]};
+    distance += diff * diff;
+  }
+  return distance;
+}
+
+#ifdef MDTILE_X86_KERNELS
+
+/*
+  SSE2
+  A tile is four 128 bit registers, two rows per register
+*/
+#define SSE2_FUNC __attribute__((target("sse2")))
+
+SSE2_FUNC bool is_blank_chr_sse2(u8 const* chr) {
+  __m128i const* in{(__m128i const*)chr};
+  __m128i all{_mm_or_si128(
+      _mm_or_si128(_mm_loadu_si128(in), _mm_loadu_si128(in + 1)),
+      _mm_or_si128(_mm_loadu_si128(in + 2), _mm_loadu_si128(in + 3)))};
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(all, _mm_setzero_si128())) ==
+         0xffff;
+}
+
+SSE2_FUNC bool is_flat_chr_sse2(u8 const* chr) {
+  __m128i const* in{(__m128i const*)chr};
+  __m128i const flatval{_mm_set1_epi8((char)*chr)};
+  __m128i all{_mm_and_si128(
+      _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(in), flatval),
+                    _mm_cmpeq_epi8(_mm_loadu_si128(in + 1), flatval)),
+      _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(in + 2), flatval),
+                    _mm_cmpeq_epi8(_mm_loadu_si128(in + 3), flatval)))};
+  return _mm_movemask_epi8(all) == 0xffff;
+}
+
+SSE2_FUNC bool is_identical_chr_sse2(u8 const* chr1, u8 const* chr2) {
+  __m128i const* in1{(__m128i const*)chr1};
+  __m128i const* in2{(__m128i const*)chr2};
+  __m128i all{_mm_and_si128(
+      _mm_and_si128(
+          _mm_cmpeq_epi8(_mm_loadu_si128(in1), _mm_loadu_si128(in2)),
+          _mm_cmpeq_epi8(_mm_loadu_si128(in1 + 1), _mm_loadu_si128(in2 + 1))),
+      _mm_and_si128(
+          _mm_cmpeq_epi8(_mm_loadu_si128(in1 + 2), _mm_loadu_si128(in2 + 2)),
+          _mm_cmpeq_epi8(_mm_loadu_si128(in1 + 3),
+                         _mm_loadu_si128(in2 + 3))))};
+  return _mm_movemask_epi8(all) == 0xffff;
+}
+
+SSE2_FUNC void vflip_chr_sse2(u8* chr) {
+  __m128i* io{(__m128i*)chr};
+  // swap the two rows within each register, then reverse the registers
+  __m128i rows01{_mm_shuffle_epi32(_mm_loadu_si128(io), 0x4e)};
+  __m128i rows23{_mm_shuffle_epi32(_mm_loadu_si128(io + 1), 0x4e)};
+  __m128i rows45{_mm_shuffle_epi32(_mm_loadu_si128(io + 2), 0x4e)};
+  __m128i rows67{_mm_shuffle_epi32(_mm_loadu_si128(io + 3), 0x4e)};
+  _mm_storeu_si128(io, rows67);
+  _mm_storeu_si128(io + 1, rows45);
+  _mm_storeu_si128(io + 2, rows23);
+  _mm_storeu_si128(io + 3, rows01);
+}
+
+SSE2_FUNC void hflip_chr_sse2(u8* chr) {
+  __m128i* io{(__m128i*)chr};
+  // no byte shuffle in SSE2: reverse the words within each row, then swap
+  // the bytes within each word
+  for (u8 this_reg{0}; this_reg < 4; ++this_reg) {
+    __m128i rows{_mm_loadu_si128(io + this_reg)};
+    rows = _mm_shufflehi_epi16(_mm_shufflelo_epi16(rows, 0x1b), 0x1b);
+    rows = _mm_or_si128(_mm_slli_epi16(rows, 8), _mm_srli_epi16(rows, 8));
+    _mm_storeu_si128(io + this_reg, rows);
+  }
+}
+
+SSE2_FUNC u32 color_distance_chr_sse2(u8 const* rgb_chr1, u8 const* rgb_chr2) {
+  __m128i const* in1{(__m128i const*)rgb_chr1};
+  __m128i const* in2{(__m128i const*)rgb_chr2};
+  __m128i const zero{_mm_setzero_si128()};
+  __m128i sum{zero};
+  // widen to 16 bits, subtract, then square and add pairs
+  for (u8 this_reg{0}; this_reg < RGB_CHR_BYTESIZE / 16; ++this_reg) {
+    __m128i const bytes1{_mm_loadu_si128(in1 + this_reg)};
+    __m128i const bytes2{_mm_loadu_si128(in2 + this_reg)};
+    __m128i const diff_lo{_mm_sub_epi16(_mm_unpacklo_epi8(bytes1, zero),
+                                        _mm_unpacklo_epi8(bytes2, zero))};
+    __m128i const diff_hi{_mm_sub_epi16(_mm_unpackhi_epi8(bytes1, zero),
+                                        _mm_unpackhi_epi8(bytes2, zero))};
+    sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(diff_lo, diff_lo),
+                                           _mm_madd_epi16(diff_hi, diff_hi)));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return (u32)_mm_cvtsi128_si32(sum);
+}
+
+#undef SSE2_FUNC
+
+/*
+  AVX2
+  A tile is two 256 bit registers, four rows per register
+*/
+#define AVX2_FUNC __attribute__((target("avx2")))
+
+AVX2_FUNC bool is_blank_chr_avx2(u8 const* chr) {
+  __m256i const* in{(__m256i const*)chr};
+  __m256i all{
+      _mm256_or_si256(_mm256_loadu_si256(in), _mm256_loadu_si256(in + 1))};
+  return _mm256_testz_si256(all, all);
+}
+
+AVX2_FUNC bool is_flat_chr_avx2(u8 const* chr) {
+  __m256i const* in{(__m256i const*)chr};
+  __m256i const flatval{_mm256_set1_epi8((char)*chr)};
+  __m256i all{
+      _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(in), flatval),
+                       _mm256_cmpeq_epi8(_mm256_loadu_si256(in + 1), flatval))};
+  return _mm256_movemask_epi8(all) == -1;
+}
+
+AVX2_FUNC bool is_identical_chr_avx2(u8 const* chr1, u8 const* chr2) {
+  __m256i const* in1{(__m256i const*)chr1};
+  __m256i const* in2{(__m256i const*)chr2};
+  __m256i diff{_mm256_or_si256(
+      _mm256_xor_si256(_mm256_loadu_si256(in1), _mm256_loadu_si256(in2)),
+      _mm256_xor_si256(_mm256_loadu_si256(in1 + 1),
+                       _mm256_loadu_si256(in2 + 1)))};
+  return _mm256_testz_si256(diff, diff);
+}
+
+AVX2_FUNC void vflip_chr_avx2(u8* chr) {
+  __m256i* io{(__m256i*)chr};
+  // reverse the rows within each register, then swap the registers
+  __m256i rows0123{_mm256_permute4x64_epi64(_mm256_loadu_si256(io), 0x1b)};
+  __m256i rows4567{
+      _mm256_permute4x64_epi64(_mm256_loadu_si256(io + 1), 0x1b)};
+  _mm256_storeu_si256(io, rows4567);
+  _mm256_storeu_si256(io + 1, rows0123);
+}
+
+AVX2_FUNC void hflip_chr_avx2(u8* chr) {
+  __m256i* io{(__m256i*)chr};
+  // reverse the bytes within each 8 byte row
+  __m256i const reverse_rows{_mm256_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+      1, 0, 15, 14, 13, 12, 11, 10, 9, 8)};
+  _mm256_storeu_si256(
+      io, _mm256_shuffle_epi8(_mm256_loadu_si256(io), reverse_rows));
+  _mm256_storeu_si256(
+      io + 1, _mm256_shuffle_epi8(_mm256_loadu_si256(io + 1), reverse_rows));
+}
+
+AVX2_FUNC u32 color_distance_chr_avx2(u8 const* rgb_chr1, u8 const* rgb_chr2) {
+  __m256i const* in1{(__m256i const*)rgb_chr1};
+  __m256i const* in2{(__m256i const*)rgb_chr2};
+  __m256i const zero{_mm256_setzero_si256()};
+  __m256i sum{zero};
+  for (u8 this_reg{0}; this_reg < RGB_CHR_BYTESIZE / 32; ++this_reg) {
+    __m256i const bytes1{_mm256_loadu_si256(in1 + this_reg)};
+    __m256i const bytes2{_mm256_loadu_si256(in2 + this_reg)};
+    __m256i const diff_lo{_mm256_sub_epi16(_mm256_unpacklo_epi8(bytes1, zero),
+                                           _mm256_unpacklo_epi8(bytes2, zero))};
+    __m256i const diff_hi{_mm256_sub_epi16(_mm256_unpackhi_epi8(bytes1, zero),
+                                           _mm256_unpackhi_epi8(bytes2, zero))};
+    sum = _mm256_add_epi32(sum,
+                           _mm256_add_epi32(_mm256_madd_epi16(diff_lo, diff_lo),
+                                            _mm256_madd_epi16(diff_hi, diff_hi)));
+  }
+  __m128i half{_mm_add_epi32(_mm256_castsi256_si128(sum),
+                             _mm256_extracti128_si256(sum, 1))};
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+  return (u32)_mm_cvtsi128_si32(half);
+}
+
+#undef AVX2_FUNC
+
+#endif
+
+}  // namespace
+
+/*
+  Dispatch
+*/
+ChrKernels const CHR_KERNELS_SCALAR{
+    "scalar", is_blank_chr_scalar,
+    is_flat_chr_scalar, is_identical_chr_scalar,
+    vflip_chr_scalar, hflip_chr_scalar,
+    color_distance_chr_scalar};
+
+#ifdef MDTILE_X86_KERNELS
+ChrKernels const CHR_KERNELS_SSE2{
+    "sse2", is_blank_chr_sse2,
+    is_flat_chr_sse2, is_identical_chr_sse2,
+    vflip_chr_sse2, hflip_chr_sse2,
+    color_distance_chr_sse2};
+
+ChrKernels const CHR_KERNELS_AVX2{
+    "avx2", is_blank_chr_avx2,
+    is_flat_chr_avx2, is_identical_chr_avx2,
+    vflip_chr_avx2, hflip_chr_avx2,
+    color_distance_chr_avx2};
+#endif
+
+ChrKernels select_chr_kernels() {
+#ifdef MDTILE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return CHR_KERNELS_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return CHR_KERNELS_SSE2;
+  }
+#endif
+  return CHR_KERNELS_SCALAR;
+}
+
+ChrKernels const chr_kernels{select_chr_kernels()};
+
+}  // namespace mdtile
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include <mdtile/chr_kernels.hpp>
+#include <mdtile/chr_utils.hpp>
+
+namespace mdtile {
+
+bool is_blank_chr(u8 const* chr) { return chr_kernels.IsBlank(chr); }
+
+bool is_flat_chr(u8 const* chr) { return chr_kernels.IsFlat(chr); }
+
+bool is_identical_chr(u8 const* chr1, u8 const* chr2) {
+  return chr_kernels.IsIdentical(chr1, chr2);
+}
+
+void vflip_chr(u8* chr) { chr_kernels.VFlip(chr); }
+
+void hflip_chr(u8* chr) { chr_kernels.HFlip(chr); }
+
+void make_rgb_chr(u8 const* chr, u8 const* palette_rgb, u8* rgb_chr) {
+  for (size_t this_pxl{0}; this_pxl < CHR_BYTESIZE; ++this_pxl) {
+    u8 const* color{palette_rgb + (chr[this_pxl] * 3)};
+    rgb_chr[this_pxl] = color[0];
+    rgb_chr[CHR_BYTESIZE + this_pxl] = color[1];
+    rgb_chr[(CHR_BYTESIZE * 2) + this_pxl] = color[2];
+  }
+}
+
+u32 color_distance_chr(u8 const* rgb_chr1, u8 const* rgb_chr2) {
+  return chr_kernels.ColorDistance(rgb_chr1, rgb_chr2);
+}
+
+std::optional<u8> split_palette_line(u8* chr) {
+  std::optional<u8> line;
+  for (size_t this_pxl{0}; this_pxl < CHR_BYTESIZE; ++this_pxl) {
+    if ((chr[this_pxl] & 0xf) == 0) {
+      continue;
+    }
+    u8 const this_line{(u8)(chr[this_pxl] >> 4)};
+    if (this_line >= PALETTE_LINES || (line && line.value() != this_line)) {
+      return std::nullopt;
+    }
+    line = this_line;
+  }
+  for (size_t this_pxl{0}; this_pxl < CHR_BYTESIZE; ++this_pxl) {
+    chr[this_pxl] &= 0xf;
+  }
+  return line.value_or(0);
+}
+
+PackedChr pack_chr(u8 const* chr) {
+  PackedChr out;
+  for (u8 this_row{0}; this_row < CHR_HEIGHT; ++this_row) {
+    u32 row_word{0};
+    for (u8 this_pxl{0}; this_pxl < CHR_WIDTH; ++this_pxl) {
+      row_word = (row_word << 4) | (*chr++ & 0xf);
+    }
+    out.Rows[this_row] = row_word;
+  }
+  return out;
+}
+
+bool is_identical_chr(PackedChr const& chr1, PackedChr const& chr2) {
+  return chr1 == chr2;
+}
+
+void vflip_chr(PackedChr& chr) {
+  std::reverse(chr.Rows.begin(), chr.Rows.end());
+}
+
+void hflip_chr(PackedChr& chr) {
+  // reverse the nibbles in each row: swap the nibbles within each byte, then
+  // reverse the bytes
+  for (auto& this_row : chr.Rows) {
+    this_row = ((this_row & 0x0f0f0f0f) << 4) | ((this_row >> 4) & 0x0f0f0f0f);
+    this_row = (this_row >> 24) | ((this_row >> 8) & 0xff00) |
+               ((this_row << 8) & 0xff0000) | (this_row << 24);
+  }
+}
+
+}  // namespace mdtile
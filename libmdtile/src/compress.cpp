@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+#include <mdtile/compress.hpp>
+#include <mdtile/output.hpp>
+
+namespace mdtile {
+
+namespace {
+
+/*
+  Kosinski
+  The data is a series of descriptor fields, each a 16 bit little endian
+  word read from the lowest bit up, with the bytes for the entries
+  described by the field following it. The next field is read as soon as
+  the last bit of the current one is used, even in the middle of an entry,
+  so any bytes of that entry come after the new field.
+  entries:
+    1                     literal: one byte
+    0 0 cc  oooooooo      inline copy: cc+2 (2 to 5) bytes from -256 to -1
+    0 1     oooooooo ooooo ccc
+                          full copy: ccc+2 (3 to 9) bytes from -8192 to -1,
+                          with the upper five bits of the offset in the
+                          second byte
+    0 1     oooooooo ooooo 000 nnnnnnnn
+                          extended copy: n+1 (3 to 256) bytes; n of 0 ends
+                          the data
+*/
+size_t const WINDOW{0x2000};
+size_t const MAX_INLINE_DISTANCE{0x100};
+size_t const MAX_INLINE_LENGTH{5};
+size_t const MIN_FULL_LENGTH{3};
+size_t const MAX_FULL_LENGTH{9};
+size_t const MAX_LENGTH{0x100};
+
+// previous positions checked for matches at each byte, nearest first
+size_t const MAX_CHAIN{256};
+
+// bits used by each type of entry, descriptor bits and bytes together
+size_t const BITS_LITERAL{9};
+size_t const BITS_INLINE{12};
+size_t const BITS_FULL{18};
+size_t const BITS_EXTENDED{26};
+
+/*
+  68000 cycles for each path through KosDec, from the instruction timings
+  reading a descriptor bit:
+    lsr.w #1 (8) move sr (6) dbf (10) move ccr (12)
+  reloading the descriptor, when dbf falls through (+4):
+    move.b (a0)+,1(sp) (16) move.b (a0)+,(sp) (12) move.w (8) moveq (4)
+  literal: one bit, bcc (8) move.b (12) bra (10)
+  inline copy: three bits, bcc (10) moveq (4) bcs (8) roxl (8) twice
+    addq (4) moveq (4) move.b (8) bra (10)
+  full copy: two bits, bcc (10) moveq (4) bcs (10) move.b (8) twice
+    moveq (4) move.b (4) lsl.w #5 (16) move.b (4) andi (8), then
+    beq (8) move.b (4) addq (4)
+  extended copy: as the full copy to beq (10), then move.b (8) beq (8)
+    cmpi.b (8) beq.w (12) move.b (4) bra (10)
+  copying: move.b (a1,d2.w),d0 (14) move.b d0,(a1)+ (8) dbf (10) for each
+    byte, with dbf falling through on the last (+4), then bra (10)
+  the setup is 48 cycles, and the end marker (the extended copy path to
+  beq (10), then the return) is 200 cycles
+*/
+size_t const CYCLES_SETUP{48};
+size_t const CYCLES_RELOAD{44};
+size_t const CYCLES_LITERAL{66};
+size_t const CYCLES_INLINE{172};
+size_t const CYCLES_FULL{164};
+size_t const CYCLES_EXTENDED{208};
+size_t const CYCLES_COPY_BYTE{32};
+size_t const CYCLES_COPY_END{14};
+size_t const CYCLES_END{200};
+
+// a match usable at a position, or a literal when Distance is 0
+struct Step {
+  size_t Length{1};
+  size_t Distance{0};
+};
+
+bool is_inline(Step const& step) {
+  return step.Length <= MAX_INLINE_LENGTH &&
+         step.Distance <= MAX_INLINE_DISTANCE;
+}
+
+// bits and cycles for an entry, or no bits when it cannot be encoded
+std::pair<size_t, size_t> step_cost(Step const& step) {
+  if (step.Distance == 0) {
+    return {BITS_LITERAL, CYCLES_LITERAL};
+  }
+  size_t const copy{(step.Length * CYCLES_COPY_BYTE) + CYCLES_COPY_END};
+  if (is_inline(step)) {
+    return {BITS_INLINE, CYCLES_INLINE + copy};
+  }
+  if (step.Length < MIN_FULL_LENGTH) {
+    return {0, 0};
+  }
+  if (step.Length <= MAX_FULL_LENGTH) {
+    return {BITS_FULL, CYCLES_FULL + copy};
+  }
+  return {BITS_EXTENDED, CYCLES_EXTENDED + copy};
+}
+
+// buffers the bytes that belong after the current descriptor field
+class KosinskiWriter {
+ public:
+  explicit KosinskiWriter(std::vector<u8>& out) : m_out{out} {}
+
+  void put_bit(bool bit) {
+    if (bit) {
+      m_descriptor |= 1 << m_bits;
+    }
+    if (++m_bits == 16) {
+      flush();
+      ++m_reloads;
+    }
+  }
+
+  void put_byte(u8 byte) { m_data.push_back(byte); }
+
+  // writes the last (possibly empty) descriptor field and its bytes
+  void finish() { flush(); }
+
+  size_t reloads() const { return m_reloads; }
+
+ private:
+  void flush() {
+    m_out.push_back(m_descriptor & 0xff);
+    m_out.push_back(m_descriptor >> 8);
+    m_out.insert(m_out.end(), m_data.begin(), m_data.end());
+    m_data.clear();
+    m_descriptor = 0;
+    m_bits = 0;
+  }
+
+  std::vector<u8>& m_out;
+  std::vector<u8> m_data;
+  u16 m_descriptor{0};
+  size_t m_bits{0};
+  size_t m_reloads{0};
+};
+
+// finds the entries of the smallest encoding, first to last
+std::vector<Step> parse(u8 const* data, size_t size) {
+  // previous positions by their first two bytes, as chains from the newest
+  size_t const NONE{SIZE_MAX};
+  std::vector<size_t> head(0x10000, NONE);
+  std::vector<size_t> prev(size, NONE);
+
+  // best[i] is the cheapest encoding of the first i bytes, as its size in
+  // bits and decode cycles, and the entry that ends it
+  struct Choice {
+    size_t Bits{SIZE_MAX};
+    size_t Cycles{0};
+    Step Last;
+  };
+  std::vector<Choice> best(size + 1);
+  best[0].Bits = 0;
+
+  auto relax = [&best](size_t from, Step const& step) {
+    auto const [bits, cycles] = step_cost(step);
+    if (bits == 0) {
+      return;
+    }
+    Choice const candidate{best[from].Bits + bits, best[from].Cycles + cycles,
+                           step};
+    Choice& this_best{best[from + step.Length]};
+    if (std::tie(candidate.Bits, candidate.Cycles) <
+        std::tie(this_best.Bits, this_best.Cycles)) {
+      this_best = candidate;
+    }
+  };
+
+  for (size_t this_pos{0}; this_pos < size; ++this_pos) {
+    relax(this_pos, {1, 0});
+    if (this_pos + 1 >= size) {
+      continue;
+    }
+
+    size_t const max_length{std::min(MAX_LENGTH, size - this_pos)};
+    size_t const key{(size_t)(data[this_pos] << 8) | data[this_pos + 1]};
+    // the longest match found so far; each longer match is taken at the
+    // nearest distance it occurs, as nearer is never more expensive
+    size_t longest{1};
+    size_t depth{0};
+    for (size_t this_match{head[key]};
+         this_match != NONE && this_pos - this_match <= WINDOW &&
+         depth < MAX_CHAIN && longest < max_length;
+         this_match = prev[this_match], ++depth) {
+      size_t length{2};
+      while (length < max_length &&
+             data[this_match + length] == data[this_pos + length]) {
+        ++length;
+      }
+      size_t const distance{this_pos - this_match};
+      for (size_t this_length{longest + 1}; this_length <= length;
+           ++this_length) {
+        relax(this_pos, {this_length, distance});
+      }
+      // a match only usable inline can still be beaten at the same length by
+      // a nearer one, so only count it once it is encodable
+      if (length > 2 || distance <= MAX_INLINE_DISTANCE) {
+        longest = std::max(longest, length);
+      }
+    }
+
+    prev[this_pos] = head[key];
+    head[key] = this_pos;
+  }
+
+  std::vector<Step> steps;
+  for (size_t this_pos{size}; this_pos > 0;
+       this_pos -= best[this_pos].Last.Length) {
+    steps.push_back(best[this_pos].Last);
+  }
+  std::reverse(steps.begin(), steps.end());
+  return steps;
+}
+
+CompressedData compress_kosinski(u8 const* data, size_t size) {
+  CompressedData out;
+  KosinskiWriter writer{out.Data};
+  size_t cycles{CYCLES_SETUP + CYCLES_END};
+
+  size_t this_pos{0};
+  for (auto const& this_step : parse(data, size)) {
+    cycles += step_cost(this_step).second;
+    if (this_step.Distance == 0) {
+      writer.put_bit(1);
+      writer.put_byte(data[this_pos]);
+    } else if (is_inline(this_step)) {
+      size_t const count{this_step.Length - 2};
+      writer.put_bit(0);
+      writer.put_bit(0);
+      writer.put_bit(count & 2);
+      writer.put_bit(count & 1);
+      writer.put_byte(-this_step.Distance & 0xff);
+    } else {
+      size_t const offset{-this_step.Distance & 0x1fff};
+      writer.put_bit(0);
+      writer.put_bit(1);
+      writer.put_byte(offset & 0xff);
+      if (this_step.Length <= MAX_FULL_LENGTH) {
+        writer.put_byte(((offset >> 5) & 0xf8) | (this_step.Length - 2));
+      } else {
+        writer.put_byte((offset >> 5) & 0xf8);
+        writer.put_byte(this_step.Length - 1);
+      }
+    }
+    this_pos += this_step.Length;
+  }
+
+  // end marker
+  writer.put_bit(0);
+  writer.put_bit(1);
+  writer.put_byte(0x00);
+  writer.put_byte(0xf0);
+  writer.put_byte(0x00);
+  writer.finish();
+
+  out.DecodeCycles = cycles + (writer.reloads() * CYCLES_RELOAD);
+  return out;
+}
+
+CompressedData compress_kosinski_moduled(u8 const* data, size_t size,
+                                         ThreadPool* pool) {
+  if (size > 0xffff) {
+    throw std::invalid_argument(
+        "Data is too large for Kosinski Moduled (over 0xffff bytes)");
+  }
+
+  size_t const module_count{(size + KOSM_MODULE_SIZE - 1) / KOSM_MODULE_SIZE};
+  std::vector<CompressedData> modules(module_count);
+  auto work = [&](size_t begin, size_t end) {
+    for (size_t this_module{begin}; this_module < end; ++this_module) {
+      size_t const offset{this_module * KOSM_MODULE_SIZE};
+      modules[this_module] = compress_kosinski(
+          data + offset, std::min(KOSM_MODULE_SIZE, size - offset));
+    }
+  };
+  if (pool != nullptr) {
+    pool->parallel_for(module_count, 1, work);
+  } else {
+    work(0, module_count);
+  }
+
+  CompressedData out;
+  put_word_be(out.Data, (u16)size);
+  for (size_t this_module{0}; this_module < module_count; ++this_module) {
+    auto const& module{modules[this_module]};
+    out.Data.insert(out.Data.end(), module.Data.begin(), module.Data.end());
+    if (this_module + 1 < module_count) {
+      out.Data.resize((out.Data.size() - 2 + 15) / 16 * 16 + 2, 0);
+    }
+    out.DecodeCycles += module.DecodeCycles;
+  }
+  return out;
+}
+
+}  // namespace
+
+std::optional<Compression> find_compression(std::string const& name) {
+  if (name == "none") {
+    return Compression::NONE;
+  }
+  if (name == "kosinski" || name == "kos") {
+    return Compression::KOSINSKI;
+  }
+  if (name == "kosm") {
+    return Compression::KOSINSKI_MODULED;
+  }
+  return std::nullopt;
+}
+
+char const* compression_extension(Compression method) {
+  switch (method) {
+    case Compression::KOSINSKI:
+      return ".kos";
+    case Compression::KOSINSKI_MODULED:
+      return ".kosm";
+    default:
+      return "";
+  }
+}
+
+CompressedData compress(u8 const* data, size_t size, Compression method,
+                        ThreadPool* pool) {
+  switch (method) {
+    case Compression::KOSINSKI:
+      return compress_kosinski(data, size);
+    case Compression::KOSINSKI_MODULED:
+      return compress_kosinski_moduled(data, size, pool);
+    default:
+      return {std::vector<u8>(data, data + size), 0};
+  }
+}
+
+void write_compressed_file(std::string const& path, std::vector<u8> const& data,
+                           Compression method, ThreadPool* pool,
+                           CompressionStats* stats) {
+  if (method == Compression::NONE) {
+    write_file(path, data);
+    return;
+  }
+
+  CompressedData const out{compress(data, method, pool)};
+  write_file(path + compression_extension(method), out.Data);
+  if (stats) {
+    stats->Bytes += data.size();
+    stats->CompressedBytes += out.Data.size();
+    stats->DecodeCycles += out.DecodeCycles;
+  }
+}
+
+}  // namespace mdtile
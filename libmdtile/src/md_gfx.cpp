@@ -0,0 +1,49 @@
+#include <mdtile/md_gfx.hpp>
+#include <mdtile/output.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace mdtile {
+
+void pack_md_chr(u8 const* in_chr, u8* out_chr) {
+#ifdef __SSE2__
+  // viewed as 16 bit words, each holds an even pixel in its low byte and an
+  // odd pixel in its high byte; combine them into the low byte and pack the
+  // words down to bytes
+  __m128i const nibble_mask{_mm_set1_epi16(0x000f)};
+  for (size_t this_block{0}; this_block < CHR_BYTESIZE / 16; ++this_block) {
+    __m128i pixels{
+        _mm_loadu_si128((__m128i const*)(in_chr + (this_block * 16)))};
+    __m128i packed{_mm_or_si128(
+        _mm_slli_epi16(_mm_and_si128(pixels, nibble_mask), 4),
+        _mm_and_si128(_mm_srli_epi16(pixels, 8), nibble_mask))};
+    _mm_storel_epi64((__m128i*)(out_chr + (this_block * 8)),
+                     _mm_packus_epi16(packed, packed));
+  }
+#else
+  for (size_t this_byte{0}; this_byte < MD_CHR_BYTESIZE; ++this_byte) {
+    out_chr[this_byte] = (u8)((in_chr[this_byte * 2] << 4) |
+                              (in_chr[(this_byte * 2) + 1] & 0xf));
+  }
+#endif
+}
+
+std::vector<u8> pack_md_chr_list(std::vector<u8*> const& tiles) {
+  std::vector<u8> out(tiles.size() * MD_CHR_BYTESIZE);
+  u8* out_ptr{out.data()};
+  for (auto const this_tile : tiles) {
+    pack_md_chr(this_tile, out_ptr);
+    out_ptr += MD_CHR_BYTESIZE;
+  }
+  return out;
+}
+
+void write_md_chr_file(std::string const& path, std::vector<u8*> const& tiles,
+                       Compression method, ThreadPool* pool,
+                       CompressionStats* stats) {
+  write_compressed_file(path, pack_md_chr_list(tiles), method, pool, stats);
+}
+
+}  // namespace mdtile
@@ -0,0 +1,189 @@
+#include <mdtile/chr_utils.hpp>
+#include <mdtile/md_gfx.hpp>
+#include <mdtile/mdtile.h>
+#include <mdtile/tileopt.hpp>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+using namespace mdtile;
+
+static_assert(MDTILE_CHR_BYTESIZE == CHR_BYTESIZE);
+static_assert(MDTILE_MD_CHR_BYTESIZE == MD_CHR_BYTESIZE);
+
+struct mdtile_result {
+  Tileset Tiles;
+};
+
+namespace {
+
+// runs a conversion, translating any exception to a status code
+template <typename F>
+int convert(mdtile_options const* opts, mdtile_result** result, F&& fn) {
+  if (!result) {
+    return MDTILE_ERR_INVALID_ARGUMENT;
+  }
+  *result = nullptr;
+
+  try {
+    mdtile_options const defaults{};
+    if (!opts) {
+      opts = &defaults;
+    }
+    TilesetOptions tileset_opts;
+    tileset_opts.Base = opts->base;
+    tileset_opts.NoMapOptimize = opts->no_map_optimize != 0;
+    if (opts->max_tiles > 0) {
+      tileset_opts.Merge.MaxTiles = opts->max_tiles;
+    }
+    if (opts->max_error > 0) {
+      tileset_opts.Merge.MaxError = opts->max_error;
+    }
+    if (tileset_opts.Merge.enabled()) {
+      if (!opts->palette && opts->palette_size > 0) {
+        return MDTILE_ERR_INVALID_ARGUMENT;
+      }
+      tileset_opts.Merge.Palette.assign(
+          opts->palette, opts->palette + (opts->palette_size * 3));
+    }
+    switch (opts->tile_order) {
+      case MDTILE_ORDER_SOURCE:
+        break;
+      case MDTILE_ORDER_ROW:
+        tileset_opts.Order = TileOrder::ROW;
+        break;
+      case MDTILE_ORDER_COLUMN:
+        tileset_opts.Order = TileOrder::COLUMN;
+        break;
+      default:
+        return MDTILE_ERR_INVALID_ARGUMENT;
+    }
+
+    tileset_opts.PaletteLines = opts->palette_lines != 0;
+    tileset_opts.ChunkWidth = opts->chunk_width;
+    tileset_opts.ChunkHeight = opts->chunk_height;
+    if ((opts->chunk_width > 0 || opts->chunk_height > 0) &&
+        (!tileset_opts.chunked() ||
+         opts->chunk_width * opts->chunk_height > MAX_CHUNK_TILES)) {
+      return MDTILE_ERR_INVALID_ARGUMENT;
+    }
+
+    std::optional<ThreadPool> pool;
+    if (opts->threads > 1) {
+      pool.emplace(opts->threads);
+    }
+
+    std::unique_ptr<mdtile_result> out{new mdtile_result};
+    out->Tiles = fn(tileset_opts, pool ? &pool.value() : nullptr);
+    *result = out.release();
+    return MDTILE_OK;
+  } catch (std::bad_alloc const&) {
+    return MDTILE_ERR_OUT_OF_MEMORY;
+  } catch (std::invalid_argument const&) {
+    return MDTILE_ERR_INVALID_ARGUMENT;
+  } catch (...) {
+    return MDTILE_ERR_INTERNAL;
+  }
+}
+
+}  // namespace
+
+extern "C" {
+
+char const* mdtile_error_string(int status) {
+  switch (status) {
+    case MDTILE_OK:
+      return "success";
+    case MDTILE_ERR_INVALID_ARGUMENT:
+      return "invalid argument";
+    case MDTILE_ERR_OUT_OF_MEMORY:
+      return "out of memory";
+    case MDTILE_ERR_INTERNAL:
+      return "internal error";
+    default:
+      return "unknown error";
+  }
+}
+
+mdtile_tile_type mdtile_classify_chr(uint8_t const* chr) {
+  if (is_blank_chr(chr)) {
+    return MDTILE_TILE_BLANK;
+  }
+  if (is_flat_chr(chr)) {
+    return MDTILE_TILE_FLAT;
+  }
+  return MDTILE_TILE_NORMAL;
+}
+
+void mdtile_pack_md_chr(uint8_t const* in_chr, uint8_t* out_chr) {
+  pack_md_chr(in_chr, out_chr);
+}
+
+int mdtile_convert_indexed(uint8_t const* pixels, size_t width, size_t height,
+                           size_t pitch, mdtile_options const* opts,
+                           mdtile_result** result) {
+  if (!pixels || pitch < width || (width / CHR_WIDTH) > 0xffff) {
+    return MDTILE_ERR_INVALID_ARGUMENT;
+  }
+  return convert(opts, result,
+                 [&](TilesetOptions const& tileset_opts, ThreadPool* pool) {
+                   return convert_indexed_image(pixels, width, height, pitch,
+                                                tileset_opts, pool);
+                 });
+}
+
+int mdtile_convert_tiles(uint8_t const* tiles, size_t count, size_t width_chr,
+                         mdtile_options const* opts, mdtile_result** result) {
+  if ((!tiles && count > 0) || width_chr == 0 || width_chr > 0xffff) {
+    return MDTILE_ERR_INVALID_ARGUMENT;
+  }
+  return convert(opts, result,
+                 [&](TilesetOptions const& tileset_opts, ThreadPool* pool) {
+                   if (!tileset_opts.PaletteLines) {
+                     return make_tileset(optimize_tiles(tiles, count, pool),
+                                         width_chr, tileset_opts, pool);
+                   }
+                   // the tiles are split on a copy, as they belong to the
+                   // caller
+                   std::vector<u8> split_tiles(tiles,
+                                               tiles + (count * CHR_BYTESIZE));
+                   std::vector<u8*> tile_ptrs(count);
+                   for (size_t this_tile{0}; this_tile < count; ++this_tile) {
+                     tile_ptrs[this_tile] =
+                         split_tiles.data() + (this_tile * CHR_BYTESIZE);
+                   }
+                   std::vector<u8> lines;
+                   split_palette_lines(tile_ptrs.data(), count, lines);
+                   auto opt_tiles{optimize_tiles(tile_ptrs, pool)};
+                   set_palette_lines(opt_tiles, lines);
+                   return make_tileset(std::move(opt_tiles), width_chr,
+                                       tileset_opts, pool);
+                 });
+}
+
+size_t mdtile_result_input_tiles(mdtile_result const* result) {
+  return result ? result->Tiles.InputTiles : 0;
+}
+
+size_t mdtile_result_output_tiles(mdtile_result const* result) {
+  return result ? result->Tiles.OutputTiles : 0;
+}
+
+uint8_t const* mdtile_result_chr(mdtile_result const* result, size_t* size) {
+  if (size) {
+    *size = result ? result->Tiles.Chr.size() : 0;
+  }
+  return result ? result->Tiles.Chr.data() : nullptr;
+}
+
+uint8_t const* mdtile_result_map(mdtile_result const* result, size_t* size) {
+  if (size) {
+    *size = result ? result->Tiles.Map.size() : 0;
+  }
+  return result ? result->Tiles.Map.data() : nullptr;
+}
+
+void mdtile_result_free(mdtile_result* result) { delete result; }
+}
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <tuple>
+#include <utility>
+
+#include <mdtile/chr_utils.hpp>
+#include <mdtile/merge.hpp>
+
+namespace mdtile {
+
+namespace {
+
+// flips are numbered with bit 0 for hflip and bit 1 for vflip, so applying
+// one flip after another is the XOR of the two
+size_t const FLIP_COUNT{4};
+
+// the search sorts the tiles into this many orders
+size_t const ORDER_COUNT{8};
+
+// each keyed by the colors of this many pixels
+size_t const SAMPLE_COUNT{8};
+
+// and compares each tile to this many tiles on either side of it in each
+size_t const SEARCH_WINDOW{8};
+
+// nearest neighbours found for each tile in each round
+size_t const NEIGHBOUR_COUNT{4};
+
+// the pixels sampled for each order
+using Samples = std::array<std::array<u8, SAMPLE_COUNT>, ORDER_COUNT>;
+
+// a unique tile in each of its four orientations
+struct MergeTile {
+  std::array<std::array<u8, RGB_CHR_BYTESIZE>, FLIP_COUNT> Rgb;
+  // the key of the tile in each order
+  std::array<std::array<uint64_t, ORDER_COUNT>, FLIP_COUNT> Key;
+  // the sum of all the channels, which orders tiles with the same key
+  std::array<u32, FLIP_COUNT> Brightness;
+};
+
+/*
+  The pixels each order is keyed by
+  They come from a fixed seed so that the same input always merges the same
+  way.
+*/
+Samples make_samples() {
+  std::mt19937 rng{0x4d44};
+  Samples samples;
+  for (auto& this_order : samples) {
+    for (auto& this_sample : this_order) {
+      this_sample = (u8)(rng() % CHR_BYTESIZE);
+    }
+  }
+  return samples;
+}
+
+void make_merge_tile(u8 const* chr, u8 const* palette_rgb,
+                     Samples const& samples, MergeTile& out) {
+  std::array<u8, CHR_BYTESIZE> work;
+  for (size_t this_flip{0}; this_flip < FLIP_COUNT; ++this_flip) {
+    std::copy(chr, chr + CHR_BYTESIZE, work.data());
+    if (this_flip & 1) {
+      hflip_chr(work.data());
+    }
+    if (this_flip & 2) {
+      vflip_chr(work.data());
+    }
+    auto const& rgb{out.Rgb[this_flip]};
+    make_rgb_chr(work.data(), palette_rgb, out.Rgb[this_flip].data());
+
+    out.Brightness[this_flip] = std::accumulate(rgb.begin(), rgb.end(), 0U);
+
+    // each sampled pixel adds the top two bits of its red, green and blue
+    for (size_t this_order{0}; this_order < ORDER_COUNT; ++this_order) {
+      uint64_t key{0};
+      for (auto const this_sample : samples[this_order]) {
+        key = (key << 6) | ((rgb[this_sample] >> 6) << 4) |
+              ((rgb[CHR_BYTESIZE + this_sample] >> 6) << 2) |
+              (rgb[(CHR_BYTESIZE * 2) + this_sample] >> 6);
+      }
+      out.Key[this_flip][this_order] = key;
+    }
+  }
+}
+
+// a tile (in one orientation) in the nearest neighbour index
+struct IndexEntry {
+  u32 Tile;
+  u8 Flip;
+};
+
+struct Neighbour {
+  u32 Distance;
+  u32 Tile;
+};
+
+/*
+  The tiles in every orientation, sorted into several orders
+  Each order is keyed by the colors of a different few pixels, coarsely, so
+  tiles that differ in only a few pixels or only slightly in color are
+  together in most of them, and the nearest neighbours of a tile are almost
+  always next to it in at least one.
+*/
+struct NeighbourIndex {
+  std::array<std::vector<IndexEntry>, ORDER_COUNT> Order;
+  // the position of each active tile (unflipped) in each order
+  std::array<std::vector<size_t>, ORDER_COUNT> Position;
+};
+
+NeighbourIndex make_index(std::vector<MergeTile> const& tiles,
+                          std::vector<u32> const& active) {
+  NeighbourIndex index;
+  for (size_t this_order{0}; this_order < ORDER_COUNT; ++this_order) {
+    auto& order{index.Order[this_order]};
+    order.reserve(active.size() * FLIP_COUNT);
+    for (auto const this_tile : active) {
+      for (u8 this_flip{0}; this_flip < FLIP_COUNT; ++this_flip) {
+        order.push_back({this_tile, this_flip});
+      }
+    }
+    auto sort_key = [&tiles, this_order](IndexEntry const& entry) {
+      MergeTile const& tile{tiles[entry.Tile]};
+      return std::make_tuple(tile.Key[entry.Flip][this_order],
+                             tile.Brightness[entry.Flip], entry.Tile,
+                             entry.Flip);
+    };
+    std::sort(order.begin(), order.end(),
+              [&sort_key](IndexEntry const& a, IndexEntry const& b) {
+                return sort_key(a) < sort_key(b);
+              });
+
+    auto& position{index.Position[this_order]};
+    position.resize(tiles.size(), 0);
+    for (size_t this_pos{0}; this_pos < order.size(); ++this_pos) {
+      if (order[this_pos].Flip == 0) {
+        position[order[this_pos].Tile] = this_pos;
+      }
+    }
+  }
+  return index;
+}
+
+/*
+  Finds the nearest tiles to the query tile (unflipped) under any flip,
+  among those next to it in each order of the index
+  This is an approximate search: a tile that is close but lands far away in
+  every order is missed, which costs a little compression but never quality.
+*/
+std::vector<Neighbour> find_neighbours(std::vector<MergeTile> const& tiles,
+                                       NeighbourIndex const& index, u32 query) {
+  MergeTile const& query_tile{tiles[query]};
+  std::vector<Neighbour> best;
+
+  auto consider = [&](IndexEntry const& entry) {
+    if (entry.Tile == query) {
+      return;
+    }
+    u32 const distance{color_distance_chr(
+        query_tile.Rgb[0].data(), tiles[entry.Tile].Rgb[entry.Flip].data())};
+    if (best.size() == NEIGHBOUR_COUNT && distance >= best.back().Distance) {
+      return;
+    }
+    // each tile appears once, with its closest orientation
+    auto existing{std::find_if(
+        best.begin(), best.end(),
+        [&entry](Neighbour const& n) { return n.Tile == entry.Tile; })};
+    if (existing != best.end()) {
+      if (existing->Distance <= distance) {
+        return;
+      }
+      best.erase(existing);
+    } else if (best.size() == NEIGHBOUR_COUNT) {
+      best.pop_back();
+    }
+    Neighbour const found{distance, entry.Tile};
+    best.insert(std::upper_bound(best.begin(), best.end(), found,
+                                 [](Neighbour const& a, Neighbour const& b) {
+                                   return a.Distance < b.Distance;
+                                 }),
+                found);
+  };
+
+  for (size_t this_order{0}; this_order < ORDER_COUNT; ++this_order) {
+    auto const& order{index.Order[this_order]};
+    size_t const position{index.Position[this_order][query]};
+    size_t const begin{position > SEARCH_WINDOW ? position - SEARCH_WINDOW : 0};
+    size_t const end{std::min(position + SEARCH_WINDOW + 1, order.size())};
+    for (size_t this_pos{begin}; this_pos < end; ++this_pos) {
+      consider(order[this_pos]);
+    }
+  }
+  return best;
+}
+
+// a possible merge of the groups holding two tiles
+struct MergeCandidate {
+  // the added error, weighted by the number of times each tile is used
+  long Cost;
+  u32 Tile1;
+  u32 Tile2;
+  // the versions of the two groups when the cost was worked out, or 0 if it
+  // is only an estimate
+  u32 Version1;
+  u32 Version2;
+
+  bool operator>(MergeCandidate const& other) const {
+    return Cost > other.Cost;
+  }
+};
+
+}  // namespace
+
+double rms_color_error(uint64_t error_sum, size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+  return std::sqrt((double)error_sum / ((double)count * CHR_BYTESIZE));
+}
+
+TileMergeResult merge_tiles(TileOptMap& opt_tiles,
+                            TileMergeOptions const& opts, ThreadPool* pool) {
+  TileMergeResult result;
+
+  // the number of times each unique tile is used in the map
+  // and, as a mask, the palette lines each is drawn with
+  auto const& uniques{opt_tiles.Tiles};
+  size_t const unique_count{uniques.size()};
+  std::vector<size_t> uses(unique_count, 0);
+  std::vector<u8> lines(unique_count, 0);
+  u8 used_lines{0};
+  for (auto const& this_cell : opt_tiles.Cells) {
+    if (this_cell.blank()) {
+      continue;
+    }
+    ++uses[this_cell.OptIdx];
+    lines[this_cell.OptIdx] |= (u8)(1 << this_cell.PaletteLine);
+    used_lines |= (u8)(1 << this_cell.PaletteLine);
+  }
+  result.TilesBefore = result.TilesAfter = unique_count;
+  if (!opts.enabled() || unique_count < 2 ||
+      (opts.MaxTiles && unique_count <= opts.MaxTiles.value())) {
+    return result;
+  }
+
+  // the limit on the squared distance of any one tile
+  u32 error_limit{UINT32_MAX};
+  if (opts.MaxError) {
+    double const limit{opts.MaxError.value() * opts.MaxError.value() *
+                       CHR_BYTESIZE};
+    error_limit = limit < UINT32_MAX ? (u32)limit : UINT32_MAX;
+  }
+
+  std::vector<u8> palette_rgb(256 * 3, 0);
+  std::copy_n(opts.Palette.begin(),
+              std::min(opts.Palette.size(), palette_rgb.size()),
+              palette_rgb.begin());
+
+  // with palette lines, a merged tile is drawn with the head's pixels in
+  // every line the tile is used with, so each tile is also colored in every
+  // line used anywhere in the image (in each orientation) to measure that
+  std::array<size_t, PALETTE_LINES> line_slot{};
+  size_t line_count{0};
+  for (size_t this_line{0}; this_line < PALETTE_LINES; ++this_line) {
+    if (used_lines & (1 << this_line)) {
+      line_slot[this_line] = line_count++;
+    }
+  }
+  std::vector<std::array<u8, RGB_CHR_BYTESIZE>> line_rgb(
+      unique_count * line_count * FLIP_COUNT);
+  auto rgb_in_line = [&](u32 tile, size_t line, u8 this_flip) {
+    return line_rgb[(((tile * line_count) + line_slot[line]) * FLIP_COUNT) +
+                    this_flip]
+        .data();
+  };
+
+  auto const samples{make_samples()};
+  std::vector<MergeTile> tiles(unique_count);
+  auto prepare_range = [&](size_t begin, size_t end) {
+    std::array<u8, CHR_BYTESIZE> work;
+    for (size_t this_tile{begin}; this_tile < end; ++this_tile) {
+      // the nearest neighbour search colors each tile by the line of its
+      // first use
+      u8 const* const data{uniques[this_tile].DataPtr};
+      make_merge_tile(data,
+                      palette_rgb.data() + (uniques[this_tile].PaletteLine *
+                                            PALETTE_LINE_COLORS * 3),
+                      samples, tiles[this_tile]);
+
+      for (size_t this_line{0}; this_line < PALETTE_LINES; ++this_line) {
+        if (!(used_lines & (1 << this_line))) {
+          continue;
+        }
+        for (u8 this_flip{0}; this_flip < FLIP_COUNT; ++this_flip) {
+          std::copy(data, data + CHR_BYTESIZE, work.data());
+          if (this_flip & 1) {
+            hflip_chr(work.data());
+          }
+          if (this_flip & 2) {
+            vflip_chr(work.data());
+          }
+          make_rgb_chr(work.data(),
+                       palette_rgb.data() +
+                           (this_line * PALETTE_LINE_COLORS * 3),
+                       rgb_in_line((u32)this_tile, this_line, this_flip));
+        }
+      }
+    }
+  };
+  if (pool) {
+    pool->parallel_for(unique_count, 256, prepare_range);
+  } else {
+    prepare_range(0, unique_count);
+  }
+
+  // groups of merged tiles
+  // each group is headed by one of its tiles, whose data is kept; every
+  // other tile in the group is drawn as the head with the flip noted here,
+  // at the error noted here
+  std::vector<u32> head(unique_count);
+  std::iota(head.begin(), head.end(), 0);
+  std::vector<std::vector<u32>> members(unique_count);
+  std::vector<size_t> group_uses{uses};
+  std::vector<u32> version(unique_count, 1);
+  std::vector<u8> flip(unique_count, 0);
+  std::vector<u32> error(unique_count, 0);
+  for (u32 this_tile{0}; this_tile < unique_count; ++this_tile) {
+    members[this_tile].push_back(this_tile);
+  }
+
+  // the error of drawing a tile as another in one palette line
+  auto line_distance = [&](u32 tile, u32 as_tile, size_t line, u8 this_flip) {
+    return color_distance_chr(rgb_in_line(tile, line, 0),
+                              rgb_in_line(as_tile, line, this_flip));
+  };
+
+  // the best flip and its error to draw a tile as another, which is the
+  // worst error over the lines the tile is used with
+  auto match = [&](u32 tile, u32 as_tile, u8& best_flip) {
+    u32 best{UINT32_MAX};
+    for (u8 this_flip{0}; this_flip < FLIP_COUNT; ++this_flip) {
+      u32 distance{0};
+      for (size_t this_line{0}; this_line < PALETTE_LINES; ++this_line) {
+        if (lines[tile] & (1 << this_line)) {
+          distance = std::max(distance,
+                              line_distance(tile, as_tile, this_line, this_flip));
+        }
+      }
+      if (distance < best) {
+        best = distance;
+        best_flip = this_flip;
+      }
+    }
+    return best;
+  };
+
+  // the head that survives a merge: that of the more used group
+  auto keep_head = [&group_uses](u32 head1, u32 head2) {
+    if (group_uses[head1] != group_uses[head2]) {
+      return group_uses[head1] > group_uses[head2] ? head1 : head2;
+    }
+    return std::min(head1, head2);
+  };
+
+  // works out the added error of merging two groups, or returns false if a
+  // tile would go over the error limit
+  auto merge_cost = [&](u32 head1, u32 head2, long& cost) {
+    u32 const kept{keep_head(head1, head2)};
+    u32 const moved{kept == head1 ? head2 : head1};
+    cost = 0;
+    u8 this_flip;
+    for (auto const this_member : members[moved]) {
+      u32 const distance{match(this_member, kept, this_flip)};
+      if (distance > error_limit) {
+        return false;
+      }
+      cost += (long)uses[this_member] * ((long)distance - error[this_member]);
+    }
+    return true;
+  };
+
+  auto merge = [&](u32 head1, u32 head2) {
+    u32 const kept{keep_head(head1, head2)};
+    u32 const moved{kept == head1 ? head2 : head1};
+    for (auto const this_member : members[moved]) {
+      error[this_member] = match(this_member, kept, flip[this_member]);
+      head[this_member] = kept;
+      members[kept].push_back(this_member);
+    }
+    members[moved].clear();
+    members[moved].shrink_to_fit();
+    group_uses[kept] += group_uses[moved];
+    ++version[kept];
+    --result.TilesAfter;
+  };
+
+  auto budget_met = [&]() {
+    return opts.MaxTiles && result.TilesAfter <= opts.MaxTiles.value();
+  };
+
+  // each round finds the nearest neighbours among the heads of the groups
+  // and merges the closest pairs first; a round that merges nothing ends it
+  std::vector<u32> active(unique_count);
+  std::iota(active.begin(), active.end(), 0);
+  while (!budget_met() && active.size() > 1) {
+    NeighbourIndex const index{make_index(tiles, active)};
+
+    std::vector<std::vector<Neighbour>> neighbours(active.size());
+    auto search_range = [&](size_t begin, size_t end) {
+      for (size_t this_idx{begin}; this_idx < end; ++this_idx) {
+        neighbours[this_idx] = find_neighbours(tiles, index, active[this_idx]);
+      }
+    };
+    if (pool) {
+      pool->parallel_for(active.size(), 64, search_range);
+    } else {
+      search_range(0, active.size());
+    }
+
+    // start with the distance alone as the cost; the true cost of each
+    // merge is worked out as it reaches the front of the queue
+    std::priority_queue<MergeCandidate, std::vector<MergeCandidate>,
+                        std::greater<MergeCandidate>>
+        queue;
+    for (size_t this_idx{0}; this_idx < active.size(); ++this_idx) {
+      for (auto const& this_neighbour : neighbours[this_idx]) {
+        if (this_neighbour.Distance > error_limit) {
+          continue;
+        }
+        queue.push({(long)this_neighbour.Distance, active[this_idx],
+                    this_neighbour.Tile, 0, 0});
+      }
+    }
+
+    bool merged{false};
+    while (!queue.empty() && !budget_met()) {
+      MergeCandidate candidate{queue.top()};
+      queue.pop();
+      u32 const head1{head[candidate.Tile1]};
+      u32 const head2{head[candidate.Tile2]};
+      if (head1 == head2) {
+        continue;
+      }
+      if (candidate.Version1 == version[head1] &&
+          candidate.Version2 == version[head2]) {
+        merge(head1, head2);
+        merged = true;
+        continue;
+      }
+      long cost;
+      if (merge_cost(head1, head2, cost)) {
+        queue.push({cost, head1, head2, version[head1], version[head2]});
+      }
+    }
+
+    if (!merged) {
+      break;
+    }
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&head](u32 tile) { return head[tile] != tile; }),
+                 active.end());
+  }
+
+  // renumber the remaining unique tiles, keeping their order
+  std::vector<u32> new_idx(unique_count);
+  u32 next_idx{0};
+  for (u32 this_tile{0}; this_tile < unique_count; ++this_tile) {
+    if (head[this_tile] == this_tile) {
+      new_idx[this_tile] = next_idx++;
+    }
+  }
+
+  // point every cell at the head of its group, combining the flips
+  for (auto& this_cell : opt_tiles.Cells) {
+    if (this_cell.blank()) {
+      continue;
+    }
+    u32 const opt_idx{this_cell.OptIdx};
+    u32 const this_head{head[opt_idx]};
+    this_cell.OptIdx = new_idx[this_head];
+    if (this_head == opt_idx) {
+      continue;
+    }
+    this_cell.HFlip ^= (flip[opt_idx] & 1) != 0;
+    this_cell.VFlip ^= (flip[opt_idx] & 2) != 0;
+
+    // the error in the line this cell is drawn with
+    u32 const cell_error{
+        line_distance(opt_idx, this_head, this_cell.PaletteLine, flip[opt_idx])};
+    result.ErrorSum += cell_error;
+    result.MaxError = std::max(result.MaxError, cell_error);
+    ++result.ChangedTiles;
+  }
+
+  // and drop the tiles that were merged away
+  std::vector<TileOptMeta> kept;
+  kept.reserve(result.TilesAfter);
+  for (u32 this_tile{0}; this_tile < unique_count; ++this_tile) {
+    if (head[this_tile] == this_tile) {
+      kept.push_back(uniques[this_tile]);
+      kept.back().OptIdx = new_idx[this_tile];
+    }
+  }
+  opt_tiles.Tiles = std::move(kept);
+
+  return result;
+}
+
+}  // namespace mdtile
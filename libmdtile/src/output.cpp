@@ -0,0 +1,69 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <mdtile/output.hpp>
+
+namespace mdtile {
+
+void put_words_be(std::vector<u8>& out, u16 const* words, size_t count) {
+  size_t const start{out.size()};
+  out.resize(start + (count * 2));
+  u8* const dest{out.data() + start};
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  std::memcpy(dest, words, count * 2);
+#else
+  // a plain loop over the block, which the compiler turns into vector
+  // shuffles
+  for (size_t this_word{0}; this_word < count; ++this_word) {
+    u16 const swapped{__builtin_bswap16(words[this_word])};
+    std::memcpy(dest + (this_word * 2), &swapped, 2);
+  }
+#endif
+}
+
+void write_file(std::string const& path, u8 const* data, size_t size) {
+  // unique across the threads of this process and across processes
+  static std::atomic<unsigned long> temp_counter{0};
+  std::string const temp_path{path + ".tmp" + std::to_string(::getpid()) +
+                              "." + std::to_string(temp_counter++)};
+
+  int const fd{::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)};
+  if (fd < 0) {
+    throw std::runtime_error("Failed to write " + path + ": " +
+                             std::strerror(errno));
+  }
+
+  // one write, unless the kernel takes less than the whole buffer
+  bool good{true};
+  while (size > 0) {
+    ssize_t const written{::write(fd, data, size)};
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      good = false;
+      break;
+    }
+    data += written;
+    size -= written;
+  }
+  int const error{good ? 0 : errno};
+  if (::close(fd) != 0 && good) {
+    good = false;
+  }
+
+  if (!good || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    int const rename_error{error ? error : errno};
+    ::unlink(temp_path.c_str());
+    throw std::runtime_error("Failed to write " + path + ": " +
+                             std::strerror(rename_error));
+  }
+}
+
+}  // namespace mdtile
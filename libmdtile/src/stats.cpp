@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include <mdtile/stats.hpp>
+
+namespace mdtile {
+
+void add_elapsed(double& total_ms,
+                 std::chrono::steady_clock::time_point const& start) {
+  total_ms += std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+}
+
+void count_tile(TileOptMeta const& tile, TileOptStats& stats) {
+  switch (tile.Type) {
+    case TileType::BLANK:
+      ++stats.BlankTiles;
+      return;
+    case TileType::FLAT:
+      ++stats.FlatTiles;
+      if (tile.DupeIdx) {
+        ++stats.FlatDupes;
+      } else {
+        ++stats.UniqueTiles;
+      }
+      return;
+    case TileType::NORMAL:
+      ++stats.NormalTiles;
+      break;
+    default:
+      return;
+  }
+
+  if (!tile.DupeIdx) {
+    ++stats.UniqueTiles;
+  } else if (tile.DupeHFlip && tile.DupeVFlip) {
+    ++stats.HVFlipDupes;
+  } else if (tile.DupeHFlip) {
+    ++stats.HFlipDupes;
+  } else if (tile.DupeVFlip) {
+    ++stats.VFlipDupes;
+  } else {
+    ++stats.ExactDupes;
+  }
+}
+
+void count_runs(std::vector<TilemapEntry> const& tilemap,
+                TileOptStats& stats) {
+  for (auto const& this_entry : tilemap) {
+    // single entries may have a run length of either none or 0
+    size_t const length{std::max<size_t>(this_entry.RunLength.value_or(1), 1)};
+    if (this_entry.TileID) {
+      ++stats.TileRuns[length];
+    } else {
+      ++stats.BlankRuns[length];
+    }
+  }
+}
+
+void add_compression(CompressionStats& total, CompressionStats const& stats) {
+  total.Bytes += stats.Bytes;
+  total.CompressedBytes += stats.CompressedBytes;
+  total.DecodeCycles += stats.DecodeCycles;
+}
+
+std::string describe_compression(CompressionStats const& stats) {
+  std::ostringstream out;
+  out << stats.Bytes << " -> " << stats.CompressedBytes << " bytes ("
+      << std::fixed << std::setprecision(1)
+      << (stats.Bytes > 0 ? (100.0 * stats.CompressedBytes / stats.Bytes) : 0)
+      << "%), ~" << stats.DecodeCycles << " cycles to decompress";
+  return out.str();
+}
+
+void add_stats(TileOptStats& total, TileOptStats const& stats) {
+  total.DecodeMs += stats.DecodeMs;
+  total.ChunkMs += stats.ChunkMs;
+  total.ClassifyMs += stats.ClassifyMs;
+  total.DedupMs += stats.DedupMs;
+  total.ReorderMs += stats.ReorderMs;
+  total.MergeMs += stats.MergeMs;
+  total.MapEncodeMs += stats.MapEncodeMs;
+  total.CompressMs += stats.CompressMs;
+  total.WriteMs += stats.WriteMs;
+  total.BlankTiles += stats.BlankTiles;
+  total.FlatTiles += stats.FlatTiles;
+  total.NormalTiles += stats.NormalTiles;
+  total.FlatDupes += stats.FlatDupes;
+  total.ExactDupes += stats.ExactDupes;
+  total.HFlipDupes += stats.HFlipDupes;
+  total.VFlipDupes += stats.VFlipDupes;
+  total.HVFlipDupes += stats.HVFlipDupes;
+  total.UniqueTiles += stats.UniqueTiles;
+  total.MapWords += stats.MapWords;
+  total.MapCycles += stats.MapCycles;
+  total.SimMapCycles += stats.SimMapCycles;
+  total.SimClearCycles += stats.SimClearCycles;
+  total.MergedTiles += stats.MergedTiles;
+  total.MergeErrorSum += stats.MergeErrorSum;
+  total.MergeChangedTiles += stats.MergeChangedTiles;
+  total.MergeMaxError = std::max(total.MergeMaxError, stats.MergeMaxError);
+  total.StripDmaBytes.insert(total.StripDmaBytes.end(),
+                             stats.StripDmaBytes.begin(),
+                             stats.StripDmaBytes.end());
+  add_compression(total.ChrCompression, stats.ChrCompression);
+  add_compression(total.MapCompression, stats.MapCompression);
+  for (auto const& this_run : stats.TileRuns) {
+    total.TileRuns[this_run.first] += this_run.second;
+  }
+  for (auto const& this_run : stats.BlankRuns) {
+    total.BlankRuns[this_run.first] += this_run.second;
+  }
+}
+
+}  // namespace mdtile
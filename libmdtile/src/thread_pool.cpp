@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <utility>
+
+#include <mdtile/thread_pool.hpp>
+
+namespace mdtile {
+
+thread_local ThreadPool* ThreadPool::tl_pool{nullptr};
+thread_local size_t ThreadPool::tl_queue{0};
+
+ThreadPool::ThreadPool(unsigned int thread_count) {
+  thread_count = std::max(thread_count, 1u);
+  for (unsigned int this_queue{0}; this_queue < thread_count; ++this_queue) {
+    m_queues.emplace_back(new WorkQueue);
+  }
+  for (size_t this_queue{1}; this_queue < thread_count; ++this_queue) {
+    m_workers.emplace_back([this, this_queue] { worker_loop(this_queue); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{m_sleep_mutex};
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto& this_worker : m_workers) {
+    this_worker.join();
+  }
+}
+
+void ThreadPool::run(TaskGroup& group, std::function<void()> task) {
+  ++group.m_pending;
+  auto wrapped = [this, &group, task{std::move(task)}] {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock{group.m_error_mutex};
+      if (!group.m_error) {
+        group.m_error = std::current_exception();
+      }
+    }
+    --group.m_pending;
+    notify();
+  };
+
+  {
+    // count the task before the queue lock is released, so that it cannot
+    // be popped (and m_queued decremented) before it has been counted
+    auto& home{*m_queues[home_queue()]};
+    std::lock_guard<std::mutex> lock{home.Mutex};
+    home.Tasks.emplace_back(std::move(wrapped));
+    ++m_queued;
+  }
+  notify();
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+  std::function<void()> task;
+  while (group.m_pending > 0) {
+    if (pop_task(task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock{m_sleep_mutex};
+    m_wake.wait(lock, [&] { return group.m_pending == 0 || m_queued > 0; });
+  }
+
+  std::lock_guard<std::mutex> lock{group.m_error_mutex};
+  if (group.m_error) {
+    std::rethrow_exception(std::exchange(group.m_error, nullptr));
+  }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t chunk_size,
+                              std::function<void(size_t, size_t)> const& work) {
+  if (count == 0) {
+    return;
+  }
+  chunk_size = std::max(chunk_size, (size_t)1);
+
+  if (m_workers.empty() || count <= chunk_size) {
+    work(0, count);
+    return;
+  }
+
+  TaskGroup group;
+  for (size_t begin{0}; begin < count; begin += chunk_size) {
+    size_t end{std::min(begin + chunk_size, count)};
+    run(group, [&work, begin, end] { work(begin, end); });
+  }
+  wait(group);
+}
+
+bool ThreadPool::pop_task(std::function<void()>& task) {
+  size_t const home{home_queue()};
+  {
+    auto& own{*m_queues[home]};
+    std::lock_guard<std::mutex> lock{own.Mutex};
+    if (!own.Tasks.empty()) {
+      task = std::move(own.Tasks.back());
+      own.Tasks.pop_back();
+      --m_queued;
+      return true;
+    }
+  }
+  for (size_t offset{1}; offset < m_queues.size(); ++offset) {
+    auto& victim{*m_queues[(home + offset) % m_queues.size()]};
+    std::lock_guard<std::mutex> lock{victim.Mutex};
+    if (!victim.Tasks.empty()) {
+      task = std::move(victim.Tasks.front());
+      victim.Tasks.pop_front();
+      --m_queued;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::notify() {
+  // take the lock so a thread that has just checked its wait condition
+  // cannot miss the wakeup
+  { std::lock_guard<std::mutex> lock{m_sleep_mutex}; }
+  m_wake.notify_all();
+}
+
+void ThreadPool::worker_loop(size_t queue_idx) {
+  tl_pool = this;
+  tl_queue = queue_idx;
+  std::function<void()> task;
+  while (true) {
+    if (pop_task(task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock{m_sleep_mutex};
+    m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+    if (m_stop && m_queued == 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace mdtile
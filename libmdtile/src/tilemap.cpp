@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include <mdtile/tilemap.hpp>
+
+namespace mdtile {
+
+namespace {
+
+/*
+  68000 cycles for each path through load_tilemap, from the instruction
+  timings (with the fetches for immediates and absolute addresses included)
+
+  label 9, writing one cell and stepping the column:
+    move.w d4,VDP_DATA (16) add #1,d7 (4) cmp.w d5,d7 (4) bne 4b (10)
+  label 4, a run in progress:
+    cmp #0,d3 (8) beq (8) subq (4) bra 9f (10)
+  label 4 into label 5, reading an entry:
+    cmp #0,d3 (8) beq (10) move.w (a0)+ (8) cmp.w #0xffff (8) beq (8)
+    move.w (4) and.w #0xe000 (8) cmp.w #0 (8)
+  then, by the type of entry:
+    single tile: beq (10) and the format at label 1 (24)
+      tile run: beq (8) cmp.w (8) bne (10) lsr.w #8 (22) lsr.w #5 (16)
+      move.w (4) subq (4) and the format at label 1 (24)
+  blank run: beq (8) cmp.w (8) bne (8) btst #12 (10) bne (8) move.w (4)
+      and.w (8) subq (4) moveq (4) bra (10)
+  palette line: beq (8) cmp.w (8) bne (8) btst #12 (10) bne (10), then
+    label 6: and.w (8) move.w (4) and.w (8) ror.w #3 (12) or.w (4)
+    bra 5b (10), which skips the run check at label 4 (-18) for the next
+    entry
+  at the end of each row, bne falls through instead (-2), then moveq (4)
+  add.l (8) bra 3b (10), and label 3 sets up the VDP address (82)
+  the setup before the first row is 128 cycles, and reading the terminator
+  and returning is 136 cycles
+*/
+size_t const CYCLES_WRITE{34};
+size_t const CYCLES_RUN_CONTINUE{30};
+size_t const CYCLES_ENTRY_READ{62};
+size_t const CYCLES_SINGLE{34};
+size_t const CYCLES_BLANK_RUN{72};
+size_t const CYCLES_PALETTE_LINE{72};
+size_t const CYCLES_TILE_RUN{96};
+size_t const CYCLES_ROW_END{20};
+size_t const CYCLES_ROW_START{82};
+size_t const CYCLES_SETUP{128};
+size_t const CYCLES_EXIT{136};
+
+// cycles to draw the cells covered by one entry
+size_t entry_cycles(bool blank, size_t length) {
+  size_t cycles{CYCLES_ENTRY_READ + CYCLES_WRITE};
+  if (blank) {
+    cycles += CYCLES_BLANK_RUN;
+  } else if (length > 1) {
+    cycles += CYCLES_TILE_RUN;
+  } else {
+    cycles += CYCLES_SINGLE;
+  }
+  return cycles + ((length - 1) * (CYCLES_RUN_CONTINUE + CYCLES_WRITE));
+}
+
+}  // namespace
+
+size_t palette_line_entries(std::vector<TilemapEntry> const& tilemap) {
+  size_t entries{0};
+  std::optional<u8> line;
+  for (auto const& this_entry : tilemap) {
+    if (this_entry.TileID && line != this_entry.PaletteLine) {
+      line = this_entry.PaletteLine;
+      ++entries;
+    }
+  }
+  return entries;
+}
+
+TilemapCost tilemap_cost(std::vector<TilemapEntry> const& tilemap,
+                         size_t width_chr, bool palette_lines) {
+  TilemapCost cost;
+  // the +2 account for width specifier and list terminator
+  cost.Words = tilemap.size() + 2;
+  cost.Cycles = CYCLES_SETUP + CYCLES_EXIT;
+  if (palette_lines) {
+    size_t const line_entries{palette_line_entries(tilemap)};
+    cost.Words += line_entries;
+    cost.Cycles += line_entries * (CYCLES_ENTRY_READ + CYCLES_PALETTE_LINE);
+  }
+
+  size_t cells{0};
+  for (auto const& this_entry : tilemap) {
+    // single entries may have a run length of either none or 0
+    size_t const length{std::max<size_t>(this_entry.RunLength.value_or(1), 1)};
+    cost.Cycles += entry_cycles(!this_entry.TileID, length);
+    cells += length;
+  }
+
+  // the VDP address is set at the start of every row, including the (empty)
+  // row where the terminator is read
+  size_t const rows{width_chr > 0 ? cells / width_chr : 0};
+  cost.Cycles += (rows * CYCLES_ROW_END) + ((rows + 1) * CYCLES_ROW_START);
+  return cost;
+}
+
+}  // namespace mdtile
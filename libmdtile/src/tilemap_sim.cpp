@@ -0,0 +1,163 @@
+#include <stdexcept>
+
+#include <mdtile/tilemap_sim.hpp>
+
+namespace mdtile {
+
+namespace {
+
+/*
+  The two routines share most of their code, so both are followed here,
+  with clear set for clear_tilemap. The register names match tilemap.s, and
+  the cycles of each instruction are noted where they are counted (with the
+  fetches for immediates and absolute addresses included, and short
+  branches taking 10 cycles, or 8 when not taken).
+*/
+TilemapSimResult run_tilemap(std::vector<u16> const& tilemap, bool clear,
+                             u32 d2, u16* vram, u16 nametable_offset,
+                             u8 tiles_per_row) {
+  TilemapSimResult result;
+  size_t& cycles{result.Cycles};
+
+  size_t a0{0};
+  auto read_word = [&]() -> u16 {
+    if (a0 >= tilemap.size()) {
+      throw std::runtime_error("Tilemap ends without a terminator");
+    }
+    ++result.Words;
+    return tilemap[a0++];
+  };
+
+  // PUSHM d0-d7 (72) moveq (4) moveq (4) and.l #0xffff (16) and.l #0xff (16)
+  // lsl.w #1 (8) move.w (a0)+ (8)
+  cycles += 128;
+  u32 d0{nametable_offset};
+  u32 const d1{(u32)tiles_per_row << 1};
+  u16 d3{0};
+  u16 d4{0};
+  u16 const d5{read_word()};
+  u16 d7{0};
+
+  // label 3: move.l (4) MAKE_VDP_ADDR: and.l (16) lsl.l #2 (12) lsr.w #2 (10)
+  // swap (4), then or.l (16) move.l d6,VDP_CTRL (20), and for clear_tilemap
+  // moveq #0,d2 (4)
+  u16 address{0};
+  auto start_row = [&] {
+    address = (u16)d0;
+    cycles += clear ? 86 : 82;
+    if (clear) {
+      d2 = 0;
+    }
+  };
+
+  // label 1: and.w #0x1fff (8) or.w (4) swap (4) add.w (4) swap (4)
+  auto format = [&](u16 entry) {
+    cycles += 24;
+    return (u16)(((entry & 0x1fff) | (u16)d2) + (u16)(d2 >> 16));
+  };
+
+  start_row();
+  while (true) {
+    // label 4: check for a run in progress
+    if (d3 != 0) {
+      // cmp (8) beq (8) subq (4) bra (10)
+      cycles += 30;
+      --d3;
+    } else {
+      // cmp (8) beq (10)
+      cycles += 18;
+      // label 5: read entries until one draws something
+      while (true) {
+        u16 const entry{read_word()};
+        // move.w (a0)+ (8) cmp.w #0xffff (8)
+        cycles += 16;
+        if (entry == 0xffff) {
+          // beq (10) POPM d0-d7 (76) rts (16)
+          cycles += 102;
+          return result;
+        }
+        // beq (8) move.w (4) and.w #0xe000 (8) cmp.w #0 (8)
+        cycles += 28;
+        u16 const rle{(u16)(entry & 0xe000)};
+        if (rle == 0) {
+          // beq (10), then format the entry (load_tilemap only)
+          cycles += 10;
+          d4 = clear ? (u16)d2 : format(entry);
+          break;
+        }
+        // beq (8) cmp.w #0x2000 (8)
+        cycles += 16;
+        if (rle == 0x2000) {
+          // bne (8) btst #12 (10)
+          cycles += 18;
+          if (entry & 0x1000) {
+            // palette line entry: bne (10)
+            cycles += 10;
+            if (!clear) {
+              // label 6: and.w #0x9fff (8) move.w (4) and.w #3 (8)
+              // ror.w #3 (12) or.w (4) bra 5b (10)
+              cycles += 46;
+              d2 = (d2 & 0xffff9fff) | ((u32)(entry & 0x3) << 13);
+            }
+            continue;
+          }
+          // blank run: bne (8) move.w (4) and.w #0x7ff (8) subq (4)
+          cycles += 24;
+          d3 = (u16)((entry & 0x7ff) - 1);
+          if (clear) {
+            // bra (10)
+            cycles += 10;
+            d4 = (u16)d2;
+          } else {
+            // moveq (4) bra (10)
+            cycles += 14;
+            d4 = 0;
+          }
+          break;
+        }
+        // tile run: bne (10) lsr.w #8 (22) lsr.w #5 (16) move.w (4) subq (4)
+        cycles += 56;
+        d3 = (u16)((rle >> 13) - 1);
+        d4 = clear ? (u16)d2 : format(entry);
+        break;
+      }
+    }
+
+    // label 9: move.w to VDP_DATA (16) add (4) cmp.w (4)
+    cycles += 24;
+    result.Cells.push_back(d4);
+    if (vram) {
+      vram[address >> 1] = d4;
+    }
+    address += 2;
+    ++d7;
+    if (d7 != d5) {
+      // bne (10)
+      cycles += 10;
+      continue;
+    }
+    // bne (8) moveq (4) add.l (8) bra 3b (10)
+    cycles += 30;
+    d7 = 0;
+    d0 += d1;
+    start_row();
+  }
+}
+
+}  // namespace
+
+TilemapSimResult simulate_load_tilemap(std::vector<u16> const& tilemap,
+                                       u32 settings, u16* vram,
+                                       u16 nametable_offset,
+                                       u8 tiles_per_row) {
+  return run_tilemap(tilemap, false, settings, vram, nametable_offset,
+                     tiles_per_row);
+}
+
+TilemapSimResult simulate_clear_tilemap(std::vector<u16> const& tilemap,
+                                        u16* vram, u16 nametable_offset,
+                                        u8 tiles_per_row) {
+  return run_tilemap(tilemap, true, 0, vram, nametable_offset, tiles_per_row);
+}
+
+}  // namespace mdtile
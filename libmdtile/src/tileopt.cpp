@@ -0,0 +1,765 @@
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <mdtile/chr_utils.hpp>
+#include <mdtile/md_gfx.hpp>
+#include <mdtile/output.hpp>
+#include <mdtile/tilemap_sim.hpp>
+#include <mdtile/tileopt.hpp>
+
+namespace mdtile {
+
+TileOptMeta classify_tile(u8* tile_data, size_t orig_idx) {
+  TileOptMeta this_tile_meta;
+
+  this_tile_meta.DataPtr = tile_data;
+  this_tile_meta.OrigIdx = orig_idx;
+
+  // check if tile is blank (all color 0, i.e. invisible)
+  if (is_blank_chr(tile_data)) {
+    this_tile_meta.IsNull = true;
+    this_tile_meta.Type = TileType::BLANK;
+    return this_tile_meta;
+  }
+
+  // check if tile is flat (all one color)
+  if (is_flat_chr(tile_data)) {
+    // if the tile is flat, set its color and move on
+    this_tile_meta.IsFlat = true;
+    this_tile_meta.Type = TileType::FLAT;
+    this_tile_meta.FlatPalEntry = tile_data[0];
+    return this_tile_meta;
+  }
+
+  // neither blank nor flat, must be normal
+  this_tile_meta.Type = TileType::NORMAL;
+
+  // the packed tile is an exact key for its content
+  this_tile_meta.Packed = pack_chr(tile_data);
+
+  return this_tile_meta;
+}
+
+void TileOptimizer::reserve(size_t tile_count) {
+  m_cells.reserve(tile_count);
+  m_normal_index.reserve(tile_count);
+}
+
+void TileOptimizer::add_tiles(u8* const* tiles, size_t count,
+                              u8 const* lines) {
+  auto phase_start{std::chrono::steady_clock::now()};
+  size_t const first_idx{m_cells.size()};
+  m_batch.resize(count);
+
+  // pass 1 - identify flat & blank tiles and pack normal tiles
+  // each tile is independent and only writes to its own meta entry, so this
+  // is split across the thread pool (if we have one)
+  auto classify_range = [&](size_t begin, size_t end) {
+    for (size_t this_tile{begin}; this_tile < end; ++this_tile) {
+      m_batch[this_tile] =
+          classify_tile(tiles[this_tile], first_idx + this_tile);
+    }
+  };
+  if (m_pool) {
+    m_pool->parallel_for(count, 1024, classify_range);
+  } else {
+    classify_range(0, count);
+  }
+
+  if (m_stats) {
+    add_elapsed(m_stats->ClassifyMs, phase_start);
+    phase_start = std::chrono::steady_clock::now();
+  }
+
+  // pass 2 - identify duplicates, keeping just the cell of each tile
+  for (size_t this_tile{0}; this_tile < count; ++this_tile) {
+    auto& work_tile{m_batch[this_tile]};
+    TileCell cell;
+    if (lines) {
+      cell.PaletteLine = work_tile.PaletteLine = lines[this_tile];
+    }
+    find_dupe(work_tile, cell);
+    m_cells.push_back(cell);
+    if (m_stats) {
+      count_tile(work_tile, *m_stats);
+    }
+  }
+
+  if (m_stats) {
+    add_elapsed(m_stats->DedupMs, phase_start);
+  }
+}
+
+TileOptMap TileOptimizer::finish() {
+  auto const phase_start{std::chrono::steady_clock::now()};
+
+  // pass 3 - re-order unique (non-dupe) tiles
+  TileOptMap out;
+  out.Tiles.reserve(m_tiles.size());
+  std::vector<u32> final_idx(m_tiles.size());
+
+  // put flats at the front
+  // no particular reason for this, just makes things "cleaner", imo
+  // then put the rest of the non-dupe tiles
+  for (auto const this_type : {TileType::FLAT, TileType::NORMAL}) {
+    for (size_t this_tile{0}; this_tile < m_tiles.size(); ++this_tile) {
+      if (m_tiles[this_tile].Type == this_type) {
+        final_idx[this_tile] = (u32)out.Tiles.size();
+        out.Tiles.push_back(m_tiles[this_tile]);
+        out.Tiles.back().OptIdx = final_idx[this_tile];
+      }
+    }
+  }
+  m_tiles.clear();
+  m_tiles.shrink_to_fit();
+  m_batch.clear();
+  m_batch.shrink_to_fit();
+
+  // all non-dupe tiles should have a final index now
+  // point each cell at the final index of its tile
+  out.Cells = std::move(m_cells);
+  for (auto& this_cell : out.Cells) {
+    if (!this_cell.blank()) {
+      this_cell.OptIdx = final_idx[this_cell.OptIdx];
+    }
+  }
+
+  if (m_stats) {
+    add_elapsed(m_stats->ReorderMs, phase_start);
+  }
+
+  return out;
+}
+
+// pass 2 works through the tiles in order, indexing each unique tile by its
+// content as we go
+// a tile whose content (natural or flipped) is already in the index is a
+// dupe of the tile found there; since the index only ever holds the first
+// tile with a given appearance, the first matching tile always wins
+// normal tiles are indexed by their packed data and flat tiles by color
+void TileOptimizer::find_dupe(TileOptMeta& work_tile, TileCell& cell) {
+  // always ignore blank tiles
+  if (work_tile.Type == TileType::BLANK) {
+    return;
+  }
+
+  // flat tiles only ever match other flats of the same color
+  if (work_tile.Type == TileType::FLAT) {
+    auto& flat_entry{m_flat_index[work_tile.FlatPalEntry]};
+    if (flat_entry) {
+      // we have a dupe!
+      mark_dupe(work_tile, cell, flat_entry.value());
+    } else {
+      flat_entry = m_tiles.size();
+      add_unique(work_tile, cell);
+    }
+    return;
+  }
+
+  // compare normal tile
+  std::optional<size_t> dupe_idx{find_normal(work_tile.Packed)};
+
+  // compare against hflip tile
+  if (!dupe_idx) {
+    m_flip_work = work_tile.Packed;
+    hflip_chr(m_flip_work);
+    dupe_idx = find_normal(m_flip_work);
+    work_tile.DupeHFlip = dupe_idx.has_value();
+  }
+
+  // compare against vflip tile
+  if (!dupe_idx) {
+    m_flip_work = work_tile.Packed;
+    vflip_chr(m_flip_work);
+    dupe_idx = find_normal(m_flip_work);
+    work_tile.DupeVFlip = dupe_idx.has_value();
+  }
+
+  // compare against hvflip tile
+  if (!dupe_idx) {
+    hflip_chr(m_flip_work);
+    dupe_idx = find_normal(m_flip_work);
+    work_tile.DupeHFlip = work_tile.DupeVFlip = dupe_idx.has_value();
+  }
+
+  if (dupe_idx) {
+    // we have a dupe!
+    mark_dupe(work_tile, cell, dupe_idx.value());
+  } else {
+    // first of its kind, add it to the index for later tiles to find
+    m_normal_index.emplace(work_tile.Packed, m_tiles.size());
+    add_unique(work_tile, cell);
+  }
+}
+
+// returns the index of the unique tile with identical content
+std::optional<size_t> TileOptimizer::find_normal(PackedChr const& chr) const {
+  auto found{m_normal_index.find(chr)};
+  if (found == m_normal_index.end()) {
+    return std::nullopt;
+  }
+  return found->second;
+}
+
+void TileOptimizer::mark_dupe(TileOptMeta& work_tile, TileCell& cell,
+                              size_t dupe_idx) {
+  work_tile.HasDupe = true;
+  work_tile.DupeIdx = m_tiles[dupe_idx].OrigIdx;
+  cell.OptIdx = (u32)dupe_idx;
+  cell.HFlip = work_tile.DupeHFlip;
+  cell.VFlip = work_tile.DupeVFlip;
+}
+
+void TileOptimizer::add_unique(TileOptMeta& work_tile, TileCell& cell) {
+  keep_data(work_tile);
+  cell.OptIdx = (u32)m_tiles.size();
+  m_tiles.push_back(work_tile);
+}
+
+void TileOptimizer::keep_data(TileOptMeta& work_tile) {
+  if (!m_keep_tile_data) {
+    return;
+  }
+  std::unique_ptr<u8[]> tile_copy{new u8[CHR_BYTESIZE]};
+  std::copy(work_tile.DataPtr, work_tile.DataPtr + CHR_BYTESIZE,
+            tile_copy.get());
+  work_tile.DataPtr = tile_copy.get();
+  m_tile_store.push_back(std::move(tile_copy));
+}
+
+TileOptMap optimize_tiles(std::vector<u8*> const& src_tiles,
+                          ThreadPool* pool, TileOptStats* stats) {
+  TileOptimizer optimizer{pool, false, stats};
+  optimizer.reserve(src_tiles.size());
+  optimizer.add_tiles(src_tiles.data(), src_tiles.size());
+  return optimizer.finish();
+}
+
+TileOptMap optimize_tiles(u8 const* src_tiles, size_t count, ThreadPool* pool,
+                          TileOptStats* stats) {
+  // the meta data points to (but never writes to) the source tiles
+  std::vector<u8*> tile_ptrs(count);
+  for (size_t this_tile{0}; this_tile < count; ++this_tile) {
+    tile_ptrs[this_tile] = const_cast<u8*>(src_tiles + (this_tile * CHR_BYTESIZE));
+  }
+  return optimize_tiles(tile_ptrs, pool, stats);
+}
+
+void split_palette_lines(u8* const* tiles, size_t count,
+                         std::vector<u8>& lines, size_t first_idx) {
+  lines.reserve(lines.size() + count);
+  for (size_t this_tile{0}; this_tile < count; ++this_tile) {
+    auto const line{split_palette_line(tiles[this_tile])};
+    if (!line) {
+      throw std::invalid_argument(
+          "Tile " + std::to_string(first_idx + this_tile) +
+          " uses colors from more than one palette line");
+    }
+    lines.push_back(line.value());
+  }
+}
+
+void set_palette_lines(TileOptMap& tiles, std::vector<u8> const& lines) {
+  for (size_t this_cell{0};
+       this_cell < std::min(tiles.Cells.size(), lines.size()); ++this_cell) {
+    tiles.Cells[this_cell].PaletteLine = lines[this_cell];
+  }
+  // each unique tile is the first use of itself
+  for (auto& this_tile : tiles.Tiles) {
+    if (this_tile.OrigIdx < lines.size()) {
+      this_tile.PaletteLine = lines[this_tile.OrigIdx];
+    }
+  }
+}
+
+// create final list of tiles to be exported
+std::vector<u8*> make_tile_list(TileOptMap const& tiles) {
+  std::vector<u8*> final_tiles;
+  final_tiles.reserve(tiles.Tiles.size());
+  for (auto const& this_tile : tiles.Tiles) {
+    final_tiles.push_back(this_tile.DataPtr);
+  }
+  return final_tiles;
+}
+
+std::vector<size_t> order_tiles(TileOptMap& tiles, size_t width_chr,
+                                TileOrder order) {
+  std::vector<size_t> strip_tiles;
+  if (order == TileOrder::SOURCE || width_chr == 0) {
+    return strip_tiles;
+  }
+
+  auto& cells{tiles.Cells};
+  size_t const height_chr{(cells.size() + width_chr - 1) / width_chr};
+  size_t const strip_count{order == TileOrder::ROW ? height_chr : width_chr};
+  size_t const strip_length{order == TileOrder::ROW ? width_chr : height_chr};
+  strip_tiles.reserve(strip_count);
+
+  // new index of each unique tile, by its current index
+  std::vector<std::optional<u32>> new_idx(tiles.Tiles.size());
+  u32 next_idx{0};
+  for (size_t this_strip{0}; this_strip < strip_count; ++this_strip) {
+    u32 const strip_start{next_idx};
+    for (size_t this_pos{0}; this_pos < strip_length; ++this_pos) {
+      size_t const tile_idx{order == TileOrder::ROW
+                                ? (this_strip * width_chr) + this_pos
+                                : (this_pos * width_chr) + this_strip};
+      if (tile_idx >= cells.size() || cells[tile_idx].blank()) {
+        continue;
+      }
+      auto& this_new_idx{new_idx[cells[tile_idx].OptIdx]};
+      if (!this_new_idx) {
+        this_new_idx = next_idx++;
+      }
+    }
+    strip_tiles.push_back(next_idx - strip_start);
+  }
+  // any tiles the map does not use go at the end
+  for (auto& this_new_idx : new_idx) {
+    if (!this_new_idx) {
+      this_new_idx = next_idx++;
+    }
+  }
+
+  for (auto& this_cell : cells) {
+    if (!this_cell.blank()) {
+      this_cell.OptIdx = new_idx[this_cell.OptIdx].value();
+    }
+  }
+  std::vector<TileOptMeta> ordered(tiles.Tiles.size());
+  for (size_t this_tile{0}; this_tile < tiles.Tiles.size(); ++this_tile) {
+    u32 const this_new_idx{new_idx[this_tile].value()};
+    ordered[this_new_idx] = tiles.Tiles[this_tile];
+    ordered[this_new_idx].OptIdx = this_new_idx;
+  }
+  tiles.Tiles = std::move(ordered);
+  return strip_tiles;
+}
+
+namespace {
+
+// the tilemap entry for a single cell
+TilemapEntry cell_entry(TileCell const& cell) {
+  TilemapEntry entry;
+  if (!cell.blank()) {
+    entry.TileID = cell.OptIdx;
+  }
+  entry.HFlip = cell.HFlip;
+  entry.VFlip = cell.VFlip;
+  entry.PaletteLine = cell.PaletteLine;
+  return entry;
+}
+
+}  // namespace
+
+std::vector<TilemapEntry> optimize_tilemap(std::vector<TileCell> const& cells,
+                                           bool no_optimize) {
+  std::vector<TilemapEntry> out_tilemap;
+
+  if (no_optimize) {
+    out_tilemap.reserve(cells.size());
+    for (auto const& this_cell : cells) {
+      out_tilemap.push_back(cell_entry(this_cell));
+    }
+    return out_tilemap;
+  }
+
+  if (cells.empty()) {
+    return out_tilemap;
+  }
+
+  size_t runlength{1};
+
+  auto this_tile{cells.begin()};
+
+  // pull in data from the first tile
+  TilemapEntry prev_tile{cell_entry(*this_tile)};
+
+  // move to the next tile to begin comparison
+  ++this_tile;
+
+  for (; this_tile != cells.end(); ++this_tile) {
+    // if this tile and the previous were empty, add to run
+    bool const blank_run{this_tile->blank() && !prev_tile.TileID};
+
+    // otherwise we're dealing with a flat or normal tile
+    // check if the tile ID, hflip, vflip and palette line are all identical
+    if (blank_run || (!this_tile->blank() && prev_tile.TileID &&
+                      (this_tile->OptIdx == prev_tile.TileID.value()) &&
+                      (this_tile->HFlip == prev_tile.HFlip) &&
+                      (this_tile->VFlip == prev_tile.VFlip) &&
+                      (this_tile->PaletteLine == prev_tile.PaletteLine))) {
+      ++runlength;
+      // max run of 7 due to only have 3 bits to work with, and blank runs
+      // are limited to the 11 bits read by load_tilemap
+      if (runlength < (blank_run ? MAX_BLANK_RUN : MAX_TILE_RUN)) {
+        // our run is not yet up to max, check the next tile
+        continue;
+      }
+      // we've hit a full run, stop and process it
+
+      // (it's important to skip over the current tile for the next check
+      // otherwise it will cause issues for long runs (runs over 7)
+      // this is because this_tile is being included as the end of a run now
+      // and if we do not skip over it, it will be marked as prev_tile in the
+      // next iteration, recognized as part of a run, and included as part
+      // of the next run as well, throwing things further and further off
+      // with the length of the run)
+      // (this was a bug that gave me quite a headache)
+      ++this_tile;
+      if (this_tile == cells.end()) {
+        // the run ended on the very last tile
+        prev_tile.RunLength = (u16)runlength;
+        out_tilemap.push_back(prev_tile);
+        return out_tilemap;
+      }
+    }
+
+    // at this point, we should have accounted for a tile run
+    if (runlength > 1) {
+      prev_tile.RunLength = (u16)runlength;
+      runlength = 1;
+    }
+    // add it
+    out_tilemap.push_back(prev_tile);
+
+    // prepare for next check
+    // load current tile into prev tile data
+    prev_tile = cell_entry(*this_tile);
+    prev_tile.RunLength = 0;
+  }
+  // need to take care of any tiles that may have been in a run
+  if (runlength > 1) {
+    prev_tile.RunLength = (u16)runlength;
+  }
+  // and account for the very last tile
+  out_tilemap.push_back(prev_tile);
+
+  return out_tilemap;
+}
+
+std::vector<u16> make_tilemap_list(
+    std::vector<TilemapEntry> const& tilemap_list, u16 tile_base, u16 width,
+    bool palette_lines) {
+  // tilemap format:
+  // |   | | |           |
+  //  xxx v h ttttttttttt
+  // t - tile id
+  // v, h - flip bits
+  // xxx - empty/run length
+
+  // for xxx, if only low bit is set, indicates this is a run of blank tiles
+  // the lower 11 bits (0 to 10) will be used for the run length of blank
+  // tiles, as that is all load_tilemap reads
+  // if any other xxx bits are set, all lower bits are as normal, and the xxx
+  // bits count as the run length
+  // with palette lines, xxx of 001 with the v bit also set sets the palette
+  // line (the low two bits) for the entries that follow
+
+  // each tilemap entry is 16 bits
+  std::vector<u16> out;
+  // the +2 account for width specifier and list terminator
+  out.reserve(tilemap_list.size() + 2);
+  out.push_back(width);
+
+  u16 this_raw_entry{0};
+  std::optional<u8> palette_line;
+  for (auto const& this_list_entry : tilemap_list) {
+    if (palette_lines && this_list_entry.TileID &&
+        palette_line != this_list_entry.PaletteLine) {
+      palette_line = this_list_entry.PaletteLine;
+      out.push_back(PALETTE_LINE_ENTRY | (palette_line.value() & 0x3));
+    }
+    this_raw_entry = 0;
+    if (!this_list_entry.TileID) {
+      // no tile id = empty tile
+      // quick bug fix - check that run length is greater than 0 before setting
+      // the empty tile run flag
+      this_raw_entry = 0x2000;
+      this_raw_entry |=
+          (this_list_entry.RunLength && this_list_entry.RunLength.value() > 0)
+              ? (this_list_entry.RunLength.value() & MAX_BLANK_RUN)
+              : 1;
+      out.push_back(this_raw_entry);
+    } else {
+      if (this_list_entry.RunLength) {
+        u8 temp{(u8)this_list_entry.RunLength.value()};
+        this_raw_entry = (temp &= 0x7);
+        this_raw_entry <<= 13;
+      }
+      this_raw_entry |= (this_list_entry.TileID.value() & 0x7ff);
+      if (this_list_entry.HFlip) {
+        this_raw_entry |= 0x800;
+      }
+      if (this_list_entry.VFlip) {
+        this_raw_entry |= 0x1000;
+      }
+      out.push_back(this_raw_entry + tile_base);
+    }
+  }
+
+  // list terminator
+  out.push_back((u16)0xffff);
+  return out;
+}
+
+namespace {
+
+/*
+  Draws the tilemap list with the simulated load_tilemap and checks every
+  cell against the tile it should show, throwing runtime_error at the first
+  that differs; the simulated cycles to load and clear the map are added to
+  the stats
+*/
+void verify_tilemap(std::vector<u16> const& tilemap_list,
+                    std::vector<TileCell> const& cells, size_t width_chr,
+                    TilesetOptions const& opts, TileOptStats* stats) {
+  auto const loaded{simulate_load_tilemap(tilemap_list)};
+  auto const cleared{simulate_clear_tilemap(tilemap_list)};
+  if (loaded.Cells.size() != cells.size() ||
+      cleared.Cells.size() != cells.size()) {
+    throw std::runtime_error(
+        "Tilemap verification failed: " + std::to_string(cells.size()) +
+        " cells in the image, but " + std::to_string(loaded.Cells.size()) +
+        " drawn and " + std::to_string(cleared.Cells.size()) + " cleared");
+  }
+
+  for (size_t this_cell{0}; this_cell < cells.size(); ++this_cell) {
+    auto const& cell{cells[this_cell]};
+    u16 expected{0};
+    if (!cell.blank()) {
+      expected = (u16)(cell.OptIdx + opts.Base) | (cell.HFlip ? 0x800 : 0) |
+                 (cell.VFlip ? 0x1000 : 0) |
+                 (u16)((cell.PaletteLine & 0x3) << 13);
+    }
+    if (loaded.Cells[this_cell] != expected || cleared.Cells[this_cell] != 0) {
+      std::ostringstream message;
+      message << "Tilemap verification failed at row " << (this_cell / width_chr)
+              << ", column " << (this_cell % width_chr) << ": expected 0x"
+              << std::hex << expected << ", drew 0x" << loaded.Cells[this_cell]
+              << " and cleared to 0x" << cleared.Cells[this_cell];
+      throw std::runtime_error(message.str());
+    }
+  }
+
+  if (stats) {
+    stats->SimMapCycles += loaded.Cycles;
+    stats->SimClearCycles += cleared.Cycles;
+  }
+}
+
+// encodes the tilemap list for the tiles, as big endian words, and adds its
+// runs and cost to the stats
+std::vector<u8> encode_tilemap(std::vector<TileCell> const& cells,
+                               size_t width_chr, TilesetOptions const& opts,
+                               TileOptStats* stats) {
+  auto const tilemap{optimize_tilemap(cells, opts.NoMapOptimize)};
+  auto final_tilemap{
+      make_tilemap_list(tilemap, opts.Base, width_chr, opts.PaletteLines)};
+  if (opts.Verify) {
+    verify_tilemap(final_tilemap, cells, width_chr, opts, stats);
+  }
+
+  // tilemap entries are big endian words
+  std::vector<u8> out;
+  put_words_be(out, final_tilemap);
+
+  if (stats) {
+    count_runs(tilemap, *stats);
+
+    TilemapCost const cost{
+        tilemap_cost(tilemap, width_chr, opts.PaletteLines)};
+    stats->MapWords += cost.Words;
+    stats->MapCycles += cost.Cycles;
+  }
+  return out;
+}
+
+}  // namespace
+
+std::vector<u8> make_chunk_index(TileOptMap const& tiles, size_t width_chr,
+                                 TilesetOptions const& opts,
+                                 TileOptStats* stats) {
+  size_t const chunk_width{opts.ChunkWidth};
+  size_t const chunk_height{opts.ChunkHeight};
+  if (chunk_width == 0 || chunk_height == 0 || width_chr == 0 ||
+      chunk_width * chunk_height > MAX_CHUNK_TILES) {
+    throw std::invalid_argument("Invalid chunk size");
+  }
+  if (tiles.Tiles.size() > 0x10000) {
+    throw std::runtime_error("Too many tiles for a chunk index");
+  }
+
+  auto const& cells{tiles.Cells};
+  size_t const height_chr{(cells.size() + width_chr - 1) / width_chr};
+  size_t const chunks_across{(width_chr + chunk_width - 1) / chunk_width};
+  size_t const chunks_down{(height_chr + chunk_height - 1) / chunk_height};
+  if (chunks_across > 0xffff || chunks_down > 0xffff) {
+    throw std::invalid_argument("Invalid chunk size");
+  }
+
+  std::vector<u8> out;
+  put_word_be(out, (u16)chunk_width);
+  put_word_be(out, (u16)chunk_height);
+  put_word_be(out, (u16)chunks_across);
+  put_word_be(out, (u16)chunks_down);
+  // the chunk offsets are filled in as each chunk is added
+  size_t const offsets_start{out.size()};
+  out.resize(offsets_start + (chunks_across * chunks_down * 4), 0);
+
+  std::vector<TileCell> chunk_cells;
+  std::vector<u32> chunk_tiles;
+  for (size_t this_chunk_y{0}; this_chunk_y < chunks_down; ++this_chunk_y) {
+    for (size_t this_chunk_x{0}; this_chunk_x < chunks_across;
+         ++this_chunk_x) {
+      size_t const left{this_chunk_x * chunk_width};
+      size_t const top{this_chunk_y * chunk_height};
+      size_t const width{std::min(chunk_width, width_chr - left)};
+      size_t const height{std::min(chunk_height, height_chr - top)};
+
+      // the tiles covered by the chunk, in map order
+      chunk_cells.clear();
+      for (size_t this_row{top}; this_row < top + height; ++this_row) {
+        for (size_t this_col{left}; this_col < left + width; ++this_col) {
+          size_t const tile_idx{(this_row * width_chr) + this_col};
+          if (tile_idx < cells.size()) {
+            chunk_cells.push_back(cells[tile_idx]);
+          }
+        }
+      }
+
+      // the tiles the chunk uses, numbered in ascending order so that runs
+      // of tiles that are contiguous in the tile set stay contiguous
+      chunk_tiles.clear();
+      for (auto const& this_cell : chunk_cells) {
+        if (!this_cell.blank()) {
+          chunk_tiles.push_back(this_cell.OptIdx);
+        }
+      }
+      std::sort(chunk_tiles.begin(), chunk_tiles.end());
+      chunk_tiles.erase(std::unique(chunk_tiles.begin(), chunk_tiles.end()),
+                        chunk_tiles.end());
+      for (auto& this_cell : chunk_cells) {
+        if (!this_cell.blank()) {
+          this_cell.OptIdx = (u32)(std::lower_bound(chunk_tiles.begin(),
+                                                    chunk_tiles.end(),
+                                                    this_cell.OptIdx) -
+                                   chunk_tiles.begin());
+        }
+      }
+
+      size_t const offset{out.size()};
+      u8* offset_ptr{out.data() + offsets_start +
+                     (((this_chunk_y * chunks_across) + this_chunk_x) * 4)};
+      offset_ptr[0] = (u8)(offset >> 24);
+      offset_ptr[1] = (u8)(offset >> 16);
+      offset_ptr[2] = (u8)(offset >> 8);
+      offset_ptr[3] = (u8)offset;
+
+      put_word_be(out, (u16)chunk_tiles.size());
+      for (auto const this_tile : chunk_tiles) {
+        put_word_be(out, (u16)this_tile);
+      }
+      auto const chunk_map{encode_tilemap(chunk_cells, width, opts, stats)};
+      out.insert(out.end(), chunk_map.begin(), chunk_map.end());
+    }
+  }
+  return out;
+}
+
+Tileset make_tileset(TileOptMap tiles, size_t width_chr,
+                     TilesetOptions const& opts, ThreadPool* pool,
+                     TileOptStats* stats) {
+  Tileset result;
+  result.InputTiles = tiles.Cells.size();
+
+  if (opts.Merge.enabled()) {
+    auto const merge_start{std::chrono::steady_clock::now()};
+    auto const merged{merge_tiles(tiles, opts.Merge, pool)};
+    if (stats) {
+      add_elapsed(stats->MergeMs, merge_start);
+      stats->MergedTiles += merged.TilesBefore - merged.TilesAfter;
+      stats->MergeErrorSum += merged.ErrorSum;
+      stats->MergeChangedTiles += merged.ChangedTiles;
+      stats->MergeMaxError = std::max(stats->MergeMaxError, merged.MaxError);
+    }
+  }
+
+  // renumber the tiles if we need a first use order
+  if (opts.Order != TileOrder::SOURCE) {
+    auto const order_start{std::chrono::steady_clock::now()};
+    auto const strip_tiles{order_tiles(tiles, width_chr, opts.Order)};
+    if (stats) {
+      add_elapsed(stats->ReorderMs, order_start);
+      for (auto const this_strip : strip_tiles) {
+        stats->StripDmaBytes.push_back(this_strip * MD_CHR_BYTESIZE);
+      }
+    }
+  }
+
+  // filter and re-order tiles
+  auto final_tiles{make_tile_list(tiles)};
+  result.OutputTiles = final_tiles.size();
+  result.Chr = pack_md_chr_list(final_tiles);
+
+  // genetate optimized tilemap list
+  auto const map_start{std::chrono::steady_clock::now()};
+  result.Map = opts.chunked()
+                   ? make_chunk_index(tiles, width_chr, opts, stats)
+                   : encode_tilemap(tiles.Cells, width_chr, opts, stats);
+  if (stats) {
+    add_elapsed(stats->MapEncodeMs, map_start);
+  }
+
+  return result;
+}
+
+std::vector<u8> chunk_indexed_image(u8 const* pixels, size_t width,
+                                    size_t height, size_t pitch) {
+  size_t const width_chr{width / CHR_WIDTH};
+  size_t const height_chr{height / CHR_HEIGHT};
+  std::vector<u8> out(width_chr * height_chr * CHR_BYTESIZE);
+
+  u8* out_ptr{out.data()};
+  for (size_t this_strip{0}; this_strip < height_chr; ++this_strip) {
+    u8 const* strip{pixels + (this_strip * CHR_HEIGHT * pitch)};
+    for (size_t this_chr{0}; this_chr < width_chr; ++this_chr) {
+      for (size_t this_row{0}; this_row < CHR_HEIGHT; ++this_row) {
+        u8 const* row{strip + (this_row * pitch) + (this_chr * CHR_WIDTH)};
+        std::copy(row, row + CHR_WIDTH, out_ptr);
+        out_ptr += CHR_WIDTH;
+      }
+    }
+  }
+  return out;
+}
+
+Tileset convert_indexed_image(u8 const* pixels, size_t width, size_t height,
+                              size_t pitch, TilesetOptions const& opts,
+                              ThreadPool* pool, TileOptStats* stats) {
+  auto chunk_start{std::chrono::steady_clock::now()};
+  std::vector<u8> tiles{chunk_indexed_image(pixels, width, height, pitch)};
+  size_t const count{tiles.size() / CHR_BYTESIZE};
+  std::vector<u8> lines;
+  if (opts.PaletteLines) {
+    std::vector<u8*> tile_ptrs(count);
+    for (size_t this_tile{0}; this_tile < count; ++this_tile) {
+      tile_ptrs[this_tile] = tiles.data() + (this_tile * CHR_BYTESIZE);
+    }
+    split_palette_lines(tile_ptrs.data(), count, lines);
+  }
+  if (stats) {
+    add_elapsed(stats->ChunkMs, chunk_start);
+  }
+
+  auto opt_tiles{optimize_tiles(tiles.data(), count, pool, stats)};
+  set_palette_lines(opt_tiles, lines);
+  return make_tileset(std::move(opt_tiles), width / CHR_WIDTH, opts, pool,
+                      stats);
+}
+
+}  // namespace mdtile
@@ -0,0 +1,145 @@
+/*
+ chr_kernels_test
+  Checks each set of SIMD kernels supported by this CPU against the scalar
+  reference, on seeded random tiles and on crafted blank, flat and nearly
+  blank or flat tiles (which random tiles almost never are)
+  Exits with 1 if any kernel disagrees with the reference
+*/
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <mdtile/chr_kernels.hpp>
+#include <random>
+#include <vector>
+
+using namespace mdtile;
+
+using Chr = std::array<u8, CHR_BYTESIZE>;
+using RgbChr = std::array<u8, RGB_CHR_BYTESIZE>;
+
+size_t const RANDOM_TILES{4096};
+
+size_t failures{0};
+
+void report(ChrKernels const& kernels, char const* kernel, size_t tile) {
+  if (++failures <= 20) {
+    std::cerr << kernels.Name << " " << kernel << " differs on tile " << tile
+              << std::endl;
+  }
+}
+
+// the tiles every kernel is run on
+std::vector<Chr> make_tiles() {
+  std::vector<Chr> tiles;
+  std::mt19937 rng{0x4d44};
+
+  // random tiles, with indices from a full palette and from one line
+  for (size_t this_tile{0}; this_tile < RANDOM_TILES; ++this_tile) {
+    Chr tile;
+    u32 const mask{this_tile % 2 == 0 ? 0xffU : 0x0fU};
+    for (auto& this_pixel : tile) {
+      this_pixel = (u8)(rng() & mask);
+    }
+    tiles.push_back(tile);
+  }
+
+  // blank and flat tiles, and each with one pixel changed in every position
+  for (u32 const this_value : {0U, 1U, 15U, 63U, 255U}) {
+    Chr flat;
+    flat.fill((u8)this_value);
+    tiles.push_back(flat);
+    for (size_t this_pixel{0}; this_pixel < CHR_BYTESIZE; ++this_pixel) {
+      Chr changed{flat};
+      changed[this_pixel] = (u8)(this_value ^ 0x01);
+      tiles.push_back(changed);
+      changed[this_pixel] = (u8)(this_value ^ 0x80);
+      tiles.push_back(changed);
+    }
+  }
+  return tiles;
+}
+
+void check_kernels(ChrKernels const& kernels, std::vector<Chr> const& tiles) {
+  ChrKernels const& ref{CHR_KERNELS_SCALAR};
+
+  for (size_t this_tile{0}; this_tile < tiles.size(); ++this_tile) {
+    Chr const& tile{tiles[this_tile]};
+    if (kernels.IsBlank(tile.data()) != ref.IsBlank(tile.data())) {
+      report(kernels, "IsBlank", this_tile);
+    }
+    if (kernels.IsFlat(tile.data()) != ref.IsFlat(tile.data())) {
+      report(kernels, "IsFlat", this_tile);
+    }
+
+    Chr expected{tile}, actual{tile};
+    ref.HFlip(expected.data());
+    kernels.HFlip(actual.data());
+    if (expected != actual) {
+      report(kernels, "HFlip", this_tile);
+    }
+    expected = actual = tile;
+    ref.VFlip(expected.data());
+    kernels.VFlip(actual.data());
+    if (expected != actual) {
+      report(kernels, "VFlip", this_tile);
+    }
+
+    // against itself, the next tile, and itself with one pixel changed
+    Chr const& next{tiles[(this_tile + 1) % tiles.size()]};
+    Chr changed{tile};
+    changed[this_tile % CHR_BYTESIZE] ^= 0x10;
+    for (Chr const* other : std::array<Chr const*, 3>{&tile, &next, &changed}) {
+      if (kernels.IsIdentical(tile.data(), other->data()) !=
+          ref.IsIdentical(tile.data(), other->data())) {
+        report(kernels, "IsIdentical", this_tile);
+      }
+    }
+  }
+
+  // RGB tiles, random and at the extremes
+  std::mt19937 rng{0x4d44};
+  for (size_t this_tile{0}; this_tile < RANDOM_TILES; ++this_tile) {
+    RgbChr rgb1, rgb2;
+    for (size_t this_byte{0}; this_byte < RGB_CHR_BYTESIZE; ++this_byte) {
+      rgb1[this_byte] = (u8)rng();
+      rgb2[this_byte] = (u8)rng();
+    }
+    if (this_tile == 0) {
+      rgb1.fill(0);
+      rgb2.fill(255);
+    }
+    if (kernels.ColorDistance(rgb1.data(), rgb2.data()) !=
+        ref.ColorDistance(rgb1.data(), rgb2.data())) {
+      report(kernels, "ColorDistance", this_tile);
+    }
+  }
+}
+
+int main() {
+  auto const tiles{make_tiles()};
+  std::vector<ChrKernels const*> to_check;
+#ifdef MDTILE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    to_check.push_back(&CHR_KERNELS_SSE2);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    to_check.push_back(&CHR_KERNELS_AVX2);
+  }
+#endif
+
+  for (auto const this_kernels : to_check) {
+    check_kernels(*this_kernels, tiles);
+    std::cout << this_kernels->Name << ": checked " << tiles.size()
+              << " tiles" << std::endl;
+  }
+  if (to_check.empty()) {
+    std::cout << "No SIMD kernels on this CPU; nothing to check" << std::endl;
+  }
+
+  if (failures > 0) {
+    std::cerr << failures << " mismatches" << std::endl;
+    return 1;
+  }
+  return 0;
+}
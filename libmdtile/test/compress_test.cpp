@@ -0,0 +1,241 @@
+/*
+ compress_test
+  Compresses seeded random, repetitive and tile-like data of edge sizes with
+  Kosinski and Kosinski Moduled, and decompresses it again with a decoder
+  written from the format description in compress.cpp
+  Exits with 1 if any data does not come back as it went in
+*/
+#include <iostream>
+#include <mdtile/compress.hpp>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace mdtile;
+
+size_t failures{0};
+
+void report(std::string const& name, char const* method,
+            std::string const& problem) {
+  if (++failures <= 20) {
+    std::cerr << name << " (" << method << "): " << problem << std::endl;
+  }
+}
+
+// reads a Kosinski stream as KosDec does, from data[pos]; pos is left after
+// the last descriptor field and its bytes
+class KosinskiReader {
+ public:
+  KosinskiReader(std::vector<u8> const& data, size_t pos)
+      : m_data{data}, m_pos{pos} {
+    reload();
+  }
+
+  // the decompressed data, or nothing if the stream is malformed
+  std::optional<std::vector<u8>> decode() {
+    std::vector<u8> out;
+    while (m_good) {
+      if (get_bit()) {
+        out.push_back(get_byte());
+        continue;
+      }
+
+      size_t distance, length;
+      if (!get_bit()) {
+        // inline copy
+        length = (get_bit() << 1) + 2;
+        length += get_bit();
+        distance = 0x100 - get_byte();
+      } else {
+        // full or extended copy
+        u8 const low{get_byte()};
+        u8 const high{get_byte()};
+        distance = 0x2000 - ((size_t)(high & 0xf8) << 5 | low);
+        length = (high & 0x07) + 2;
+        if ((high & 0x07) == 0) {
+          u8 const count{get_byte()};
+          if (count == 0) {
+            break;
+          }
+          // 1 is not written by the compressor
+          if (count == 1) {
+            return std::nullopt;
+          }
+          length = count + 1;
+        }
+      }
+
+      if (distance > out.size()) {
+        return std::nullopt;
+      }
+      for (size_t this_byte{0}; this_byte < length; ++this_byte) {
+        out.push_back(out[out.size() - distance]);
+      }
+    }
+    if (!m_good) {
+      return std::nullopt;
+    }
+    return out;
+  }
+
+  size_t pos() const { return m_pos; }
+
+ private:
+  bool get_bit() {
+    bool const bit{(m_descriptor & 1) != 0};
+    m_descriptor >>= 1;
+    if (++m_bits == 16) {
+      reload();
+    }
+    return bit;
+  }
+
+  u8 get_byte() {
+    if (m_pos >= m_data.size()) {
+      m_good = false;
+      return 0;
+    }
+    return m_data[m_pos++];
+  }
+
+  void reload() {
+    m_descriptor = get_byte();
+    m_descriptor |= get_byte() << 8;
+    m_bits = 0;
+  }
+
+  std::vector<u8> const& m_data;
+  size_t m_pos;
+  u16 m_descriptor{0};
+  size_t m_bits{0};
+  bool m_good{true};
+};
+
+std::optional<std::vector<u8>> decode_kosinski(std::vector<u8> const& data) {
+  KosinskiReader reader{data, 0};
+  auto out{reader.decode()};
+  // nothing may follow the stream
+  if (reader.pos() != data.size()) {
+    return std::nullopt;
+  }
+  return out;
+}
+
+std::optional<std::vector<u8>> decode_kosinski_moduled(
+    std::vector<u8> const& data) {
+  if (data.size() < 2) {
+    return std::nullopt;
+  }
+  size_t const size{(size_t)(data[0] << 8) | data[1]};
+  std::vector<u8> out;
+  size_t pos{2};
+  while (out.size() < size) {
+    KosinskiReader reader{data, pos};
+    auto const module{reader.decode()};
+    if (!module || (module->size() != KOSM_MODULE_SIZE &&
+                    out.size() + module->size() != size)) {
+      return std::nullopt;
+    }
+    out.insert(out.end(), module->begin(), module->end());
+    // every module but the last is padded to 16 bytes
+    pos = reader.pos();
+    if (out.size() < size) {
+      pos = ((pos - 2 + 15) / 16 * 16) + 2;
+    }
+  }
+  if (pos != data.size()) {
+    return std::nullopt;
+  }
+  return out;
+}
+
+void check(std::string const& name, std::vector<u8> const& data) {
+  struct Method {
+    Compression Method;
+    char const* Name;
+    std::optional<std::vector<u8>> (*Decode)(std::vector<u8> const&);
+  };
+  for (auto const& this_method :
+       {Method{Compression::KOSINSKI, "kosinski", decode_kosinski},
+        Method{Compression::KOSINSKI_MODULED, "kosm",
+               decode_kosinski_moduled}}) {
+    if (this_method.Method == Compression::KOSINSKI_MODULED &&
+        data.size() > 0xffff) {
+      continue;
+    }
+    CompressedData const out{compress(data, this_method.Method)};
+    auto const decoded{this_method.Decode(out.Data)};
+    if (!decoded) {
+      report(name, this_method.Name, "malformed stream");
+    } else if (*decoded != data) {
+      report(name, this_method.Name, "data differs");
+    }
+    // (empty Kosinski Moduled data has no modules to decode)
+    if (out.DecodeCycles == 0 && !data.empty()) {
+      report(name, this_method.Name, "no decode cycles");
+    }
+  }
+}
+
+int main() {
+  std::mt19937 rng{0x4b4f};
+  size_t checked{0};
+  auto run = [&checked](std::string const& name, std::vector<u8> const& data) {
+    check(name + " " + std::to_string(data.size()), data);
+    ++checked;
+  };
+
+  // sizes around the descriptor field, the copy lengths and distances, and
+  // the module size
+  for (size_t const this_size :
+       {0, 1, 2, 3, 15, 16, 17, 255, 256, 257, 0x1fff, 0x2000, 0x2001, 0x0fff,
+        0x1000, 0x1001, 0x3000, 0xffff}) {
+    std::vector<u8> random(this_size), repeated(this_size),
+        pattern(this_size), noisy(this_size);
+    for (size_t this_byte{0}; this_byte < this_size; ++this_byte) {
+      random[this_byte] = (u8)rng();
+      repeated[this_byte] = 0x11;
+      // runs of every length, repeated at every distance up to the window
+      pattern[this_byte] = (u8)((this_byte / (1 + this_byte % 13)) & 0x0f);
+      // few values, so that short matches are everywhere
+      noisy[this_byte] = (u8)(rng() & 0x03);
+    }
+    run("random", random);
+    run("repeated", repeated);
+    run("pattern", pattern);
+    run("noisy", noisy);
+  }
+
+  // tile-like data: a set of 32 byte tiles picked at random, so that the
+  // nearest copy of a tile is often beyond the inline and full windows
+  for (size_t const this_tiles : {64, 512, 2047}) {
+    std::vector<std::vector<u8>> set(this_tiles / 4);
+    for (auto& this_set_tile : set) {
+      for (size_t this_byte{0}; this_byte < 32; ++this_byte) {
+        this_set_tile.push_back((u8)rng());
+      }
+    }
+    std::vector<u8> tiles;
+    for (size_t this_tile{0}; this_tile < this_tiles; ++this_tile) {
+      auto const& tile{set[rng() % set.size()]};
+      tiles.insert(tiles.end(), tile.begin(), tile.end());
+    }
+    run("tiles", tiles);
+  }
+
+  // Kosinski Moduled holds at most 0xffff bytes
+  try {
+    compress(std::vector<u8>(0x10000), Compression::KOSINSKI_MODULED);
+    report("0x10000 bytes", "kosm", "no exception");
+  } catch (std::invalid_argument const&) {
+  }
+
+  std::cout << "Checked " << checked << " blocks" << std::endl;
+  if (failures > 0) {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  return 0;
+}
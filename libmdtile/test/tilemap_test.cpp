@@ -0,0 +1,296 @@
+/*
+ tilemap_test
+  Encodes crafted maps with optimize_tilemap and make_tilemap_list (and as
+  chunk indices with make_chunk_index), draws them with the simulated
+  load_tilemap and clear_tilemap, and checks that every cell comes back as
+  it went in and that tilemap_cost agrees with the simulated words and
+  cycles
+  The maps cover blank runs around the 0x7ff cap, tile runs around 7, flipped
+  dupes, palette line entries and chunked maps
+  Exits with 1 if any map does not round trip
+*/
+#include <algorithm>
+#include <iostream>
+#include <mdtile/tilemap.hpp>
+#include <mdtile/tilemap_sim.hpp>
+#include <mdtile/tileopt.hpp>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace mdtile;
+
+size_t failures{0};
+
+void report(std::string const& name, std::string const& problem) {
+  if (++failures <= 20) {
+    std::cerr << name << ": " << problem << std::endl;
+  }
+}
+
+TileCell blank() { return TileCell{}; }
+
+TileCell tile(u32 idx, bool hflip = false, bool vflip = false, u8 line = 0) {
+  TileCell cell;
+  cell.OptIdx = idx;
+  cell.HFlip = hflip;
+  cell.VFlip = vflip;
+  cell.PaletteLine = line;
+  return cell;
+}
+
+// the nametable entry load_tilemap should draw for a cell
+u16 expected_entry(TileCell const& cell, u16 base) {
+  if (cell.blank()) {
+    return 0;
+  }
+  return (u16)(cell.OptIdx + base) | (cell.HFlip ? 0x800 : 0) |
+         (cell.VFlip ? 0x1000 : 0) | (u16)((cell.PaletteLine & 0x3) << 13);
+}
+
+// draws one encoded map and checks it against its cells
+void check_list(std::string const& name, std::vector<u16> const& list,
+                std::vector<TilemapEntry> const& tilemap,
+                std::vector<TileCell> const& cells, size_t width_chr,
+                u16 base, bool palette_lines) {
+  TilemapSimResult loaded, cleared;
+  try {
+    loaded = simulate_load_tilemap(list);
+    cleared = simulate_clear_tilemap(list);
+  } catch (std::runtime_error const& e) {
+    report(name, e.what());
+    return;
+  }
+
+  if (loaded.Cells.size() != cells.size() ||
+      cleared.Cells.size() != cells.size()) {
+    report(name, std::to_string(cells.size()) + " cells, but " +
+                     std::to_string(loaded.Cells.size()) + " drawn and " +
+                     std::to_string(cleared.Cells.size()) + " cleared");
+    return;
+  }
+  for (size_t this_cell{0}; this_cell < cells.size(); ++this_cell) {
+    if (loaded.Cells[this_cell] != expected_entry(cells[this_cell], base) ||
+        cleared.Cells[this_cell] != 0) {
+      report(name, "cell " + std::to_string(this_cell) + " differs");
+      return;
+    }
+  }
+
+  TilemapCost const cost{tilemap_cost(tilemap, width_chr, palette_lines)};
+  if (cost.Words != list.size() || loaded.Words != list.size()) {
+    report(name, "tilemap_cost has " + std::to_string(cost.Words) +
+                     " words, the list " + std::to_string(list.size()) +
+                     " and load_tilemap read " +
+                     std::to_string(loaded.Words));
+  }
+  if (cost.Cycles != loaded.Cycles) {
+    report(name, "tilemap_cost has " + std::to_string(cost.Cycles) +
+                     " cycles, load_tilemap took " +
+                     std::to_string(loaded.Cycles));
+  }
+}
+
+size_t checked{0};
+
+// encodes the cells with and without runs, and checks both
+void check_map(std::string const& name, std::vector<TileCell> const& cells,
+               size_t width_chr, bool palette_lines = false, u16 base = 0) {
+  for (bool const no_optimize : {false, true}) {
+    auto const tilemap{optimize_tilemap(cells, no_optimize)};
+    auto const list{
+        make_tilemap_list(tilemap, base, (u16)width_chr, palette_lines)};
+    check_list(name + (no_optimize ? " (no runs)" : ""), list, tilemap, cells,
+               width_chr, base, palette_lines);
+    ++checked;
+  }
+}
+
+u16 read_word(std::vector<u8> const& data, size_t pos) {
+  return (u16)((data.at(pos) << 8) | data.at(pos + 1));
+}
+
+// builds a chunk index for the cells, and draws each chunk's tilemap with
+// its tiles mapped back to their index in the whole tile set
+void check_chunks(std::string const& name, std::vector<TileCell> const& cells,
+                  size_t tile_count, size_t width_chr, size_t chunk_width,
+                  size_t chunk_height, bool palette_lines = false) {
+  TileOptMap map;
+  map.Tiles.resize(tile_count);
+  map.Cells = cells;
+  TilesetOptions opts;
+  opts.ChunkWidth = chunk_width;
+  opts.ChunkHeight = chunk_height;
+  opts.PaletteLines = palette_lines;
+  auto const index{make_chunk_index(map, width_chr, opts)};
+
+  size_t const height_chr{cells.size() / width_chr};
+  size_t const chunks_across{read_word(index, 4)};
+  size_t const chunks_down{read_word(index, 6)};
+  if (read_word(index, 0) != chunk_width ||
+      read_word(index, 2) != chunk_height ||
+      chunks_across != (width_chr + chunk_width - 1) / chunk_width ||
+      chunks_down != (height_chr + chunk_height - 1) / chunk_height) {
+    report(name, "bad chunk index header");
+    return;
+  }
+
+  for (size_t this_chunk{0}; this_chunk < chunks_across * chunks_down;
+       ++this_chunk) {
+    std::string const chunk_name{name + " chunk " +
+                                 std::to_string(this_chunk)};
+    size_t pos{((size_t)read_word(index, 8 + (this_chunk * 4)) << 16) |
+               read_word(index, 10 + (this_chunk * 4))};
+    std::vector<u16> chunk_tiles(read_word(index, pos));
+    pos += 2;
+    for (auto& this_tile : chunk_tiles) {
+      this_tile = read_word(index, pos);
+      pos += 2;
+    }
+    std::vector<u16> list;
+    do {
+      list.push_back(read_word(index, pos));
+      pos += 2;
+    } while (list.back() != 0xffff);
+
+    // the cells of the chunk, with their local tile indices
+    size_t const left{(this_chunk % chunks_across) * chunk_width};
+    size_t const top{(this_chunk / chunks_across) * chunk_height};
+    size_t const width{std::min(chunk_width, width_chr - left)};
+    size_t const height{std::min(chunk_height, height_chr - top)};
+    std::vector<TileCell> chunk_cells;
+    for (size_t this_row{top}; this_row < top + height; ++this_row) {
+      for (size_t this_col{left}; this_col < left + width; ++this_col) {
+        chunk_cells.push_back(cells[(this_row * width_chr) + this_col]);
+      }
+    }
+    for (auto& this_cell : chunk_cells) {
+      if (this_cell.blank()) {
+        continue;
+      }
+      auto const local{std::find(chunk_tiles.begin(), chunk_tiles.end(),
+                                 this_cell.OptIdx)};
+      if (local == chunk_tiles.end()) {
+        report(chunk_name, "a tile is missing from the chunk's tile list");
+        return;
+      }
+      this_cell.OptIdx = (u32)(local - chunk_tiles.begin());
+    }
+
+    check_list(chunk_name, list,
+               optimize_tilemap(chunk_cells, opts.NoMapOptimize), chunk_cells,
+               width, 0, palette_lines);
+    ++checked;
+  }
+}
+
+int main() {
+  std::mt19937 rng{0x4d41};
+
+  // blank runs: around the 0x7ff cap, and across rows
+  for (size_t const this_blanks :
+       {1, 2, 0x7fe, 0x7ff, 0x800, 0x801, (2 * 0x7ff) + 3}) {
+    std::vector<TileCell> cells(this_blanks, blank());
+    cells.push_back(tile(1));
+    // pad out to whole rows of 64
+    while (cells.size() % 64 != 0) {
+      cells.push_back(blank());
+    }
+    check_map("blanks " + std::to_string(this_blanks), cells, 64);
+    // the first run is as long as load_tilemap allows
+    auto const first{optimize_tilemap(cells).front()};
+    if (first.RunLength.value_or(1) !=
+        std::min<size_t>(this_blanks, MAX_BLANK_RUN)) {
+      report("blanks " + std::to_string(this_blanks), "first run is " +
+                 std::to_string(first.RunLength.value_or(1)) + " long");
+    }
+  }
+  check_map("all blank", std::vector<TileCell>(64 * 64, blank()), 64);
+
+  // tile runs: around the 7 cap, with and without flips, and ending on the
+  // last cell
+  for (size_t this_run{1}; this_run <= 16; ++this_run) {
+    std::vector<TileCell> cells;
+    cells.push_back(tile(2));
+    for (size_t this_cell{0}; this_cell < this_run; ++this_cell) {
+      cells.push_back(tile(5, this_run % 2 == 0, this_run % 3 == 0));
+    }
+    cells.push_back(blank());
+    check_map("run " + std::to_string(this_run), cells, cells.size());
+    cells.pop_back();
+    check_map("run " + std::to_string(this_run) + " at the end", cells,
+              cells.size());
+  }
+
+  // flipped dupes: one tile in every orientation, alone and in runs, which
+  // must not run into each other
+  {
+    std::vector<TileCell> cells;
+    for (size_t this_repeat{0}; this_repeat < 4; ++this_repeat) {
+      for (u8 this_flip{0}; this_flip < 4; ++this_flip) {
+        for (size_t this_cell{0}; this_cell <= this_repeat * 3;
+             ++this_cell) {
+          cells.push_back(tile(9, this_flip & 1, this_flip & 2));
+        }
+      }
+    }
+    while (cells.size() % 16 != 0) {
+      cells.push_back(tile(9, true, true));
+    }
+    check_map("flips", cells, 16);
+    check_map("flips with base", cells, 16, false, 0x100);
+  }
+
+  // palette lines: a line entry before the first tile and at every change,
+  // with blanks (which keep the line) in between, and runs split by line
+  {
+    std::vector<TileCell> cells;
+    for (size_t this_cell{0}; this_cell < 32 * 24; ++this_cell) {
+      u8 const line{(u8)((this_cell / 5) % 4)};
+      if (this_cell % 11 == 0) {
+        cells.push_back(blank());
+      } else {
+        cells.push_back(tile((u32)(this_cell / 9), (this_cell / 3) % 2 == 0,
+                             false, line));
+      }
+    }
+    check_map("palette lines", cells, 32, true);
+    check_map("palette lines with base", cells, 32, true, 0x40);
+    std::vector<TileCell> one_line(cells.size(), tile(3, false, true, 2));
+    check_map("one palette line", one_line, 32, true);
+  }
+
+  // random maps, with long runs of blanks and tiles and all the flips and
+  // lines
+  std::vector<std::vector<TileCell>> random_maps;
+  for (size_t this_map{0}; this_map < 8; ++this_map) {
+    size_t const width{(size_t)(8 << (this_map % 4))};
+    bool const palette_lines{this_map % 2 == 1};
+    std::vector<TileCell> cells;
+    while (cells.size() < width * 40) {
+      size_t const run{1 + (rng() % (rng() % 4 == 0 ? 600 : 12))};
+      TileCell const cell{
+          rng() % 3 == 0
+              ? blank()
+              : tile(rng() % 300, rng() % 2, rng() % 2,
+                     palette_lines ? (u8)(rng() % 4) : 0)};
+      cells.insert(cells.end(), run, cell);
+    }
+    cells.resize(width * 40);
+    check_map("random " + std::to_string(this_map), cells, width,
+              palette_lines);
+    check_chunks("random " + std::to_string(this_map), cells, 300, width, 8,
+                 8, palette_lines);
+    // chunks that do not divide the map, leaving smaller chunks at the edges
+    check_chunks("random " + std::to_string(this_map) + " odd chunks", cells,
+                 300, width, 5, 7, palette_lines);
+  }
+
+  std::cout << "Checked " << checked << " tilemaps" << std::endl;
+  if (failures > 0) {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  return 0;
+}
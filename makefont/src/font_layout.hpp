@@ -0,0 +1,163 @@
+#ifndef MAKEFONT__FONT_LAYOUT_HPP
+#define MAKEFONT__FONT_LAYOUT_HPP
+
+#include <algorithm>
+#include <chrgfx/chrgfx.hpp>
+#include <mdtile/chr_utils.hpp>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace chrgfx;
+using namespace mdtile;
+
+/*
+	Font layout
+	The image is a sheet of glyph cells, each cell_width x cell_height tiles,
+	read left to right and top to bottom. The tiles of each glyph are taken a
+	row at a time or a column at a time.
+	The code points of the cells come from a list of code point ranges, where
+	the nth code point listed is the nth cell of the sheet, so the sheet can
+	be in any order (and cells past the end of the list are left out). The
+	glyphs are output in code point order.
+*/
+
+enum class GlyphOrder { ROW, COLUMN };
+
+// an inclusive range of code points
+struct CodeRange {
+	u32 First{0};
+	u32 Last{0};
+};
+
+struct FontLayout {
+	// the tiles, shared between glyphs if dedup is on
+	std::vector<u8 *> Tiles;
+	// for each glyph, the index of each of its tiles in Tiles, in glyph order
+	std::vector<u16> GlyphTiles;
+};
+
+/*
+	Parses a list of code points and ranges, such as 0x20-0x7e,0xa5
+	Values may be decimal, or hex with 0x.
+*/
+std::vector<CodeRange> parse_code_ranges(std::string const &list)
+{
+	std::vector<CodeRange> out;
+	size_t pos{0};
+	while(pos <= list.size()) {
+		size_t end{list.find(',', pos)};
+		if(end == std::string::npos) {
+			end = list.size();
+		}
+		std::string const item{list.substr(pos, end - pos)};
+		size_t const dash{item.find('-')};
+		CodeRange range;
+		range.First = std::stoul(item.substr(0, dash), nullptr, 0);
+		range.Last = dash == std::string::npos
+										 ? range.First
+										 : std::stoul(item.substr(dash + 1), nullptr, 0);
+		if(range.Last < range.First) {
+			throw std::invalid_argument("Code point range " + item + " is backwards");
+		}
+		out.push_back(range);
+		pos = end + 1;
+	}
+	return out;
+}
+
+/*
+	Lists the cells of the sheet in code point order
+	Without any ranges, every cell is used in sheet order. Throws
+	invalid_argument if a code point is listed twice.
+*/
+std::vector<size_t> order_glyph_cells(std::vector<CodeRange> const &ranges,
+																			size_t cell_count)
+{
+	std::vector<size_t> out;
+	if(ranges.empty()) {
+		for(size_t this_cell{0}; this_cell < cell_count; ++this_cell) {
+			out.push_back(this_cell);
+		}
+		return out;
+	}
+
+	std::vector<std::pair<u32, size_t>> codes;
+	for(auto const &this_range : ranges) {
+		for(u32 this_code{this_range.First};
+				this_code <= this_range.Last && codes.size() < cell_count;
+				++this_code) {
+			codes.push_back({this_code, codes.size()});
+		}
+	}
+	std::sort(codes.begin(), codes.end());
+	for(size_t this_code{0}; this_code < codes.size(); ++this_code) {
+		if(this_code > 0 && codes[this_code].first == codes[this_code - 1].first) {
+			throw std::invalid_argument("Code point " +
+																	std::to_string(codes[this_code].first) +
+																	" is listed more than once");
+		}
+		out.push_back(codes[this_code].second);
+	}
+	return out;
+}
+
+/*
+	Orders the tiles of the glyphs
+	cells are the sheet cells to use, in output order. With dedup, each
+	distinct tile is stored once and glyphs refer to it through GlyphTiles;
+	without it, each glyph's tiles are stored together as before.
+*/
+FontLayout make_font_layout(chrbank const &src_tiles, size_t img_chr_width,
+														size_t cell_width, size_t cell_height,
+														GlyphOrder order, std::vector<size_t> const &cells,
+														bool dedup)
+{
+	FontLayout out;
+	size_t const cells_per_row{img_chr_width / cell_width};
+	std::unordered_map<PackedChr, u16, PackedChrHash> tile_index;
+
+	auto add_tile = [&](u8 *tile) {
+		PackedChr const packed{pack_chr(tile)};
+		if(dedup) {
+			auto const existing{tile_index.find(packed)};
+			if(existing != tile_index.end()) {
+				out.GlyphTiles.push_back(existing->second);
+				return;
+			}
+		}
+		if(out.Tiles.size() > 0xffff) {
+			throw std::runtime_error("Too many tiles for the glyph table");
+		}
+		tile_index.emplace(packed, (u16)out.Tiles.size());
+		out.GlyphTiles.push_back((u16)out.Tiles.size());
+		out.Tiles.push_back(tile);
+	};
+
+	for(auto const this_cell : cells) {
+		size_t const cell_x{(this_cell % cells_per_row) * cell_width};
+		size_t const cell_y{(this_cell / cells_per_row) * cell_height};
+		auto tile_at = [&](size_t x, size_t y) {
+			return src_tiles.at(((cell_y + y) * img_chr_width) + cell_x + x).get();
+		};
+
+		if(order == GlyphOrder::ROW) {
+			for(size_t this_y{0}; this_y < cell_height; ++this_y) {
+				for(size_t this_x{0}; this_x < cell_width; ++this_x) {
+					add_tile(tile_at(this_x, this_y));
+				}
+			}
+		} else {
+			for(size_t this_x{0}; this_x < cell_width; ++this_x) {
+				for(size_t this_y{0}; this_y < cell_height; ++this_y) {
+					add_tile(tile_at(this_x, this_y));
+				}
+			}
+		}
+	}
+
+	return out;
+}
+
+#endif
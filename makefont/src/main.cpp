@@ -1,15 +1,19 @@
 #include <chrgfx/chrgfx.hpp>
 #include <filesystem>
-#include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <mdtile/compress.hpp>
+#include <mdtile/md_chrgfx.hpp>
+#include <mdtile/md_gfx.hpp>
+#include <mdtile/output.hpp>
 #include <vector>
 
 #include "common.hpp"
-#include "md_gfx.hpp"
+#include "font_layout.hpp"
 #include "project.hpp"
 
 using namespace chrgfx;
+using namespace mdtile;
 
 int process_args(int argc, char **argv);
 void print_help();
@@ -17,7 +21,15 @@ void print_help();
 struct runtime_config {
 	std::string inpng_filepath{""};
 	std::string output{""};
-
+	Compression compress{Compression::NONE};
+	// glyph cell size in tiles
+	size_t cell_width{1};
+	size_t cell_height{2};
+	GlyphOrder order{GlyphOrder::COLUMN};
+	std::vector<CodeRange> codes;
+	// share identical tiles between glyphs; off by default so the .chr keeps
+	// each glyph's tiles together, as before
+	bool dedup{false};
 } cfg;
 
 int main(int argc, char **argv)
@@ -64,24 +76,29 @@ int main(int argc, char **argv)
 		// make sure our tile counts match
 		assert(tile_count == (img_width_chr * img_height_chr));
 
-		// we might make this tool more useful in the future
-		// for now, we're just using it for 8x16 fonts
-		std::vector<u8 *> ordered_chrs;
-
-		for(size_t row{0}; row < img_height_chr; row += 2) {
-			for(int col{0}; col < img_width_chr; ++col) {
-				size_t upper_tile = (row * img_width_chr) + col;
-				size_t lower_tile = ((row + 1) * img_width_chr) + col;
-				ordered_chrs.push_back(src_tiles.at(upper_tile).get());
-				ordered_chrs.push_back(src_tiles.at(lower_tile).get());
-			}
+		size_t const cell_count{(img_width_chr / cfg.cell_width) *
+														(img_height_chr / cfg.cell_height)};
+		auto const cells{order_glyph_cells(cfg.codes, cell_count)};
+		auto const layout{make_font_layout(src_tiles, img_width_chr, cfg.cell_width,
+																			 cfg.cell_height, cfg.order, cells,
+																			 cfg.dedup)};
+
+		CompressionStats chr_stats;
+		write_md_chr_file(cfg.output + ".chr", layout.Tiles, cfg.compress, nullptr,
+											&chr_stats);
+		if(cfg.compress != Compression::NONE) {
+			std::cout << "Compressed tiles: " << describe_compression(chr_stats)
+								<< std::endl;
 		}
 
-		std::ofstream tile_data_file(std::string(cfg.output + ".chr"));
-		for(auto this_tile : ordered_chrs) {
-			tile_data_file.write(
-					(char *)chrgfx::conv_chr::cvto_chr(MD_CHR, this_tile), 32);
-		}
+		// the tile index of each tile of each glyph, as big endian words
+		std::vector<u8> idx_data;
+		put_words_be(idx_data, layout.GlyphTiles);
+		write_file(cfg.output + ".idx", idx_data);
+
+		std::cout << "Glyphs: " << cells.size() << std::endl;
+		std::cout << "Tile count: " << layout.Tiles.size() << " (of "
+							<< layout.GlyphTiles.size() << " in the glyphs)" << std::endl;
 
 	} catch(std::exception const &e) {
 		std::cerr << "Fatal Error: " << e.what() << std::endl;
@@ -95,8 +112,13 @@ int process_args(int argc, char **argv)
 {
 	std::vector<option> long_opts{{"image", required_argument, nullptr, 'i'},
 																{"output", required_argument, nullptr, 'o'},
+																{"compress", required_argument, nullptr, 'z'},
+																{"cell", required_argument, nullptr, 'c'},
+																{"order", required_argument, nullptr, 'r'},
+																{"codes", required_argument, nullptr, 'C'},
+																{"dedup", no_argument, nullptr, 'd'},
 																{"help", no_argument, nullptr, 'h'}};
-	std::string short_opts{":i:o:O:P:Th"};
+	std::string short_opts{":i:o:O:P:z:c:r:C:dTh"};
 
 	while(true) {
 		const auto this_opt =
@@ -115,6 +137,53 @@ int process_args(int argc, char **argv)
 				cfg.output = optarg;
 				break;
 
+			case 'z': {
+				auto const method{find_compression(optarg)};
+				if(!method) {
+					throw std::invalid_argument("Compression must be none, kosinski or kosm");
+				}
+				cfg.compress = method.value();
+				break;
+			}
+
+			// glyph cell size in pixels, as WxH
+			case 'c': {
+				std::string const cell{optarg};
+				size_t const split{cell.find('x')};
+				if(split == std::string::npos) {
+					throw std::invalid_argument("Cell size must be given as WxH");
+				}
+				size_t const width{std::stoul(cell.substr(0, split))};
+				size_t const height{std::stoul(cell.substr(split + 1))};
+				if(width == 0 || height == 0 || width % 8 != 0 || height % 8 != 0) {
+					throw std::invalid_argument(
+							"Cell width and height must be multiples of 8");
+				}
+				cfg.cell_width = width / 8;
+				cfg.cell_height = height / 8;
+				break;
+			}
+
+			case 'r': {
+				std::string const order{optarg};
+				if(order == "row") {
+					cfg.order = GlyphOrder::ROW;
+				} else if(order == "column") {
+					cfg.order = GlyphOrder::COLUMN;
+				} else {
+					throw std::invalid_argument("Order must be row or column");
+				}
+				break;
+			}
+
+			case 'C':
+				cfg.codes = parse_code_ranges(optarg);
+				break;
+
+			case 'd':
+				cfg.dedup = true;
+				break;
+
 			// help
 			case 'h':
 				print_help();
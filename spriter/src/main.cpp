@@ -1,21 +1,25 @@
 #include <chrgfx/chrgfx.hpp>
 #include <filesystem>
-#include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <mdtile/compress.hpp>
+#include <mdtile/md_chrgfx.hpp>
+#include <mdtile/md_gfx.hpp>
+#include <mdtile/output.hpp>
 #include <png++/png.hpp>
 #include <vector>
 
 #include "common.hpp"
 #include "parse_sprdef.hpp"
 #include "project.hpp"
+#include "sprite_cover.hpp"
 #include "sprite_makechr.hpp"
 #include "sprite_maketbl.hpp"
+#include "sprite_stream.hpp"
 #include "spritedef.hpp"
 
-#include "md_gfx.hpp"
-
 using namespace chrgfx;
+using namespace mdtile;
 
 struct runtime_config {
 	std::string inpng_filepath{""};
@@ -23,6 +27,10 @@ struct runtime_config {
 	std::string sprdef{""};
 	u16 base{0};
 	bool make_palette{false};
+	Compression compress{Compression::NONE};
+	bool stream{false};
+	size_t dma_budget{7168};
+	std::string compile_sprdef{""};
 };
 
 int process_args(runtime_config &cfg, int argc, char **argv);
@@ -44,6 +52,15 @@ int main(int argc, char **argv)
 				return process_args_result;
 			}
 
+			// compiling the sprite definitions needs nothing else
+			if(!cfg.compile_sprdef.empty()) {
+				auto const defs{parse_sprdef(cfg.sprdef)};
+				write_sprdef_bin(cfg.compile_sprdef, defs);
+				std::cout << "Compiled " << std::to_string(defs.size())
+									<< " sprite definitions" << std::endl;
+				return 0;
+			}
+
 			if(cfg.inpng_filepath.empty()) {
 				std::cerr << "No input image specified" << std::endl;
 				return -1;
@@ -52,6 +69,10 @@ int main(int argc, char **argv)
 			if(cfg.output.empty()) {
 				cfg.output = std::filesystem::path(cfg.inpng_filepath).filename();
 			}
+
+			if(cfg.stream && cfg.compress != Compression::NONE) {
+				throw std::invalid_argument("Streamed tiles cannot be compressed");
+			}
 		} catch(std::exception const &e) {
 			std::cerr << "Invalid argument: " << e.what() << std::endl;
 			return -5;
@@ -79,60 +100,94 @@ int main(int argc, char **argv)
 		assert(tile_count == (img_width_chr * img_height_chr));
 
 		// read in our spritedefs
-		auto sprite_defs{parse_sprdef(cfg.sprdef)};
+		auto frame_defs{parse_sprdef(cfg.sprdef)};
+
+		// split frames larger than a hardware sprite into sprites
+		auto sprite_defs{cover_frames(src_tiles, frame_defs, img_width_chr)};
 
 		// make ordered list of chrs
-		auto chr_list{make_chr(src_tiles, sprite_defs, img_width_chr)};
+		std::vector<u8 *> chr_list;
+		// also holds the padding tile in the list when streaming
+		StreamChr stream;
+		if(cfg.stream) {
+			stream = make_stream_chr(src_tiles, sprite_defs, img_width_chr,
+															 frame_defs.size(), cfg.base, cfg.dma_budget);
+			chr_list = stream.Tiles;
+		} else {
+			chr_list = make_chr(src_tiles, sprite_defs, img_width_chr);
+		}
 
 		// write tile data to file
-		std::ofstream tile_data_file(std::string(cfg.output + ".chr"));
-		for(auto this_tile : chr_list) {
-			tile_data_file.write(
-					(char *)chrgfx::conv_chr::cvto_chr(MD_CHR, this_tile), 32);
+		CompressionStats chr_stats;
+		write_md_chr_file(cfg.output + ".chr", chr_list, cfg.compress, nullptr,
+											&chr_stats);
+		if(cfg.compress != Compression::NONE) {
+			std::cout << "Compressed tiles: " << describe_compression(chr_stats)
+								<< std::endl;
 		}
-		tile_data_file.close();
 
 		auto spr_list{make_tbl(sprite_defs, cfg.base)};
 
-		std::ofstream tile_map_file(std::string(cfg.output + ".spr"));
-
-		u8 *(*copyfunc)(u8 *, u8 *, u8 *);
-		if(chrgfx::bigend_sys) {
-			copyfunc = std::copy;
-		} else {
-			copyfunc = std::reverse_copy;
-		}
-		size_t out_iter{0};
-		u8 temp[2];
-		for(auto this_raw_entry : spr_list) {
-			copyfunc((u8 *)&this_raw_entry[0], (u8 *)&this_raw_entry[0] + 2, temp);
-			tile_map_file.write((char const *)temp, 2);
-
-			copyfunc((u8 *)&this_raw_entry[1], (u8 *)&this_raw_entry[1] + 2, temp);
-			tile_map_file.write((char const *)temp, 2);
-
-			copyfunc((u8 *)&this_raw_entry[2], (u8 *)&this_raw_entry[2] + 2, temp);
-			tile_map_file.write((char const *)temp, 2);
-
-			copyfunc((u8 *)&this_raw_entry[3], (u8 *)&this_raw_entry[3] + 2, temp);
-			tile_map_file.write((char const *)temp, 2);
-
-			++out_iter;
+		// each sprite table entry is four big endian words, and the entries are
+		// contiguous, so the whole table is swapped and written as one block
+		static_assert(sizeof(spr_list[0]) == 8, "sprite entries must be packed");
+		std::vector<u8> spr_data;
+		put_words_be(spr_data, spr_list.empty() ? nullptr : spr_list[0].data(),
+								 spr_list.size() * 4);
+		write_file(cfg.output + ".spr", spr_data);
+
+		// the first entry and entry count of each frame
+		auto frm_list{make_frame_tbl(sprite_defs, frame_defs.size())};
+		static_assert(sizeof(frm_list[0]) == 4, "frame entries must be packed");
+		std::vector<u8> frm_data;
+		put_words_be(frm_data, frm_list.empty() ? nullptr : frm_list[0].data(),
+								 frm_list.size() * 2);
+		write_file(cfg.output + ".frm", frm_data);
+
+		// the transfer for each frame: source offset (long), length in words
+		// and VRAM address; a length of 0 means the frame has no tiles and no
+		// DMA should be started for it
+		size_t largest_transfer{0};
+		if(cfg.stream) {
+			std::vector<u8> dma_data;
+			for(auto const &this_transfer : stream.Transfers) {
+				put_long_be(dma_data, this_transfer.Source);
+				put_word_be(dma_data, this_transfer.Length);
+				put_word_be(dma_data, this_transfer.Dest);
+				largest_transfer =
+						std::max(largest_transfer, (size_t)this_transfer.Length * 2);
+			}
+			write_file(cfg.output + ".dma", dma_data);
 		}
-		tile_map_file.close();
 
 		// dump palette if requested
 		if(cfg.make_palette) {
 			uptr<u8> out_pal{chrgfx::conv_palette::cvto_pal(MD_PAL, MD_COL,
 																											in_image.get_palette())};
-			std::ofstream tile_palette_file(std::string(cfg.output + ".pal"));
-			tile_palette_file.write((char *)out_pal.get(),
-															MD_PAL.get_palette_datasize_bytes());
-			tile_palette_file.close();
+			write_file(cfg.output + ".pal", out_pal.get(),
+								 MD_PAL.get_palette_datasize_bytes());
 		}
 
-		std::cout << "Tile count: " << std::to_string(chr_list.size()) << std::endl;
+		// tiles the sprites would use without sharing
+		size_t sprite_tile_count{0};
+		for(auto const &this_def : sprite_defs) {
+			if(this_def.IsValid) {
+				sprite_tile_count += this_def.SpriteWidth * this_def.SpriteHeight;
+			}
+		}
+		std::cout << "Tile count: " << std::to_string(chr_list.size()) << " (of "
+							<< std::to_string(sprite_tile_count) << " in the sprites)"
+							<< std::endl;
 		std::cout << "Sprite entries: " << std::to_string(spr_list.size())
+							<< " in " << std::to_string(frm_list.size()) << " frames"
+							<< std::endl;
+		if(cfg.stream) {
+			std::cout << "Largest frame transfer: " << std::to_string(largest_transfer)
+								<< " bytes" << std::endl;
+		}
+		auto const load{line_load(sprite_defs)};
+		std::cout << "Most on one line: " << std::to_string(load.LineSprites)
+							<< " sprites, " << std::to_string(load.LinePixels) << " pixels"
 							<< std::endl;
 
 	} catch(std::exception const &e) {
@@ -150,8 +205,12 @@ int process_args(runtime_config &cfg, int argc, char **argv)
 																{"output", required_argument, nullptr, 'o'},
 																{"base", required_argument, nullptr, 'b'},
 																{"make-palette", no_argument, nullptr, 'p'},
+																{"compress", required_argument, nullptr, 'z'},
+																{"stream", no_argument, nullptr, 'S'},
+																{"dma-budget", required_argument, nullptr, 'B'},
+																{"compile-sprdef", required_argument, nullptr, 'c'},
 																{"help", no_argument, nullptr, 'h'}};
-	std::string short_opts{":i:o:b:ph"};
+	std::string short_opts{":i:s:o:b:z:B:c:Sph"};
 
 	while(true) {
 		const auto this_opt =
@@ -180,6 +239,27 @@ int process_args(runtime_config &cfg, int argc, char **argv)
 				cfg.make_palette = true;
 				break;
 
+			case 'S':
+				cfg.stream = true;
+				break;
+
+			case 'B':
+				cfg.dma_budget = std::stoul(optarg);
+				break;
+
+			case 'c':
+				cfg.compile_sprdef = optarg;
+				break;
+
+			case 'z': {
+				auto const method{find_compression(optarg)};
+				if(!method) {
+					throw std::invalid_argument("Compression must be none, kosinski or kosm");
+				}
+				cfg.compress = method.value();
+				break;
+			}
+
 			// help
 			case 'h':
 				print_help();
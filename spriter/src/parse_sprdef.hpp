@@ -2,67 +2,234 @@
 #define SPRITER__PARSE_SPRDEF_HPP
 
 #include "spritedef.hpp"
+#include <algorithm>
 #include <cerrno>
 #include <chrgfx/types.hpp>
-#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <mdtile/output.hpp>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-template <typename T> T sto(std::string const &val, int base = 10)
+/*
+	Sprite definition files
+	The text form has one definition per line: the tile x and y of the sprite
+	in the image, its width and height in tiles, and its next (link) value, as
+	decimal numbers separated by commas. Blank lines are skipped, as are bad
+	lines (after reporting where they went wrong).
+	The compiled form, written by write_sprdef_bin, is the SPRDEF_MAGIC
+	header, the number of definitions (big endian long) and 8 bytes for each
+	definition: x and y (big endian words), width, height, next and a pad
+	byte. parse_sprdef reads either form.
+*/
+
+constexpr char SPRDEF_MAGIC[8]{'S', 'P', 'R', 'D', 'E', 'F', '0', '1'};
+constexpr size_t SPRDEF_BIN_HEADER_SIZE{12};
+constexpr size_t SPRDEF_BIN_ENTRY_SIZE{8};
+
+// a read only mapping of a whole file
+class MappedFile
 {
-	signed long temp{std::stol(val, nullptr, base)};
-	if(temp < std::numeric_limits<T>::min() ||
-		 temp > std::numeric_limits<T>::max()) {
-		throw std::out_of_range("Value does not fit in specified type");
+public:
+	explicit MappedFile(std::string const &path)
+	{
+		int const fd{::open(path.c_str(), O_RDONLY)};
+		if(fd < 0) {
+			throw std::ios_base::failure(std::strerror(errno));
+		}
+		struct stat info;
+		if(::fstat(fd, &info) != 0) {
+			int const error{errno};
+			::close(fd);
+			throw std::ios_base::failure(std::strerror(error));
+		}
+		m_size = info.st_size;
+		// an empty file cannot be mapped, and has nothing to read anyway
+		if(m_size > 0) {
+			void *const data{::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+			if(data == MAP_FAILED) {
+				int const error{errno};
+				::close(fd);
+				throw std::ios_base::failure(std::strerror(error));
+			}
+			m_data = (char const *)data;
+		}
+		::close(fd);
 	}
-	return (T)temp;
-}
 
-/**
- * Converts a comma delimited list of integer values into a vector
- */
-template <typename T> std::vector<T> vd_int_array(std::string const &val)
-{
-	std::vector<T> out;
+	~MappedFile()
+	{
+		if(m_data != nullptr) {
+			::munmap((void *)m_data, m_size);
+		}
+	}
 
-	std::istringstream ss{val};
-	std::string this_value;
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
 
-	while(std::getline(ss, this_value, ',')) {
-		out.push_back(sto<T>(this_value));
+	std::string_view view() const
+	{
+		return {m_data, m_size};
 	}
-	return out;
+
+private:
+	char const *m_data{nullptr};
+	size_t m_size{0};
+};
+
+inline u16 get_word_be(char const *data)
+{
+	return (u16)(((u8)data[0] << 8) | (u8)data[1]);
 }
 
-vector<SpriteDef> parse_sprdef(std::string const &def_file)
+vector<SpriteDef> parse_sprdef_bin(std::string_view data)
 {
-	std::ifstream in{def_file};
-	if(!in.good()) {
-		throw std::ios_base::failure(std::strerror(errno));
+	size_t const count{((size_t)get_word_be(data.data() + 8) << 16) |
+										 get_word_be(data.data() + 10)};
+	if((data.size() - SPRDEF_BIN_HEADER_SIZE) / SPRDEF_BIN_ENTRY_SIZE < count) {
+		throw std::runtime_error("Compiled sprite definitions are truncated");
 	}
 
-	in.seekg(std::ios::beg);
+	vector<SpriteDef> out(count);
+	char const *entry{data.data() + SPRDEF_BIN_HEADER_SIZE};
+	for(auto &this_def : out) {
+		this_def.SourceTileX = get_word_be(entry);
+		this_def.SourceTileY = get_word_be(entry + 2);
+		this_def.SpriteWidth = (u8)entry[4];
+		this_def.SpriteHeight = (u8)entry[5];
+		this_def.Next = (u8)entry[6];
+		entry += SPRDEF_BIN_ENTRY_SIZE;
+	}
+	return out;
+}
 
-	std::string this_line{};
+/*
+	Parses the text form in a single pass over the mapped file, without
+	allocating anything but the output
+*/
+vector<SpriteDef> parse_sprdef_text(std::string const &def_file,
+																		std::string_view data)
+{
 	vector<SpriteDef> out;
+	out.reserve(std::count(data.begin(), data.end(), '\n') + 1);
 
-	while(std::getline(in, this_line)) {
-		try {
-			auto this_values{vd_int_array<unsigned int>(this_line)};
-			SpriteDef tempdef;
-			tempdef.SourceTileX = this_values[0];
-			tempdef.SourceTileY = this_values[1];
-			tempdef.SpriteWidth = this_values[2];
-			tempdef.SpriteHeight = this_values[3];
-			tempdef.Next = this_values[4];
-			out.push_back(tempdef);
-		} catch(std::exception const &e) {
-			std::cerr << "Failed to parse sprite definition: " << this_line
-								<< std::endl;
+	size_t line_no{0};
+	size_t pos{0};
+	while(pos < data.size()) {
+		size_t line_end{data.find('\n', pos)};
+		if(line_end == std::string_view::npos) {
+			line_end = data.size();
+		}
+		std::string_view const line{data.substr(pos, line_end - pos)};
+		pos = line_end + 1;
+		++line_no;
 
+		size_t col{0};
+		auto skip_space = [&] {
+			while(col < line.size() &&
+						(line[col] == ' ' || line[col] == '\t' || line[col] == '\r')) {
+				++col;
+			}
+		};
+		skip_space();
+		if(col == line.size()) {
 			continue;
 		}
+
+		// the five values, with the largest each may be
+		static constexpr unsigned long limits[5]{0xffff, 0xffff, 0xff, 0xff, 0xff};
+		unsigned long values[5];
+		char const *error{nullptr};
+		size_t value_count{0};
+		while(error == nullptr) {
+			skip_space();
+			if(col == line.size() || line[col] < '0' || line[col] > '9') {
+				error = "Expected a number";
+				break;
+			}
+			unsigned long value{0};
+			size_t const value_col{col};
+			while(col < line.size() && line[col] >= '0' && line[col] <= '9') {
+				value = (value * 10) + (line[col++] - '0');
+				if(value > 0xffffff) {
+					break;
+				}
+			}
+			if(value_count == 5) {
+				col = value_col;
+				error = "Too many values (expected 5)";
+				break;
+			}
+			if(value > limits[value_count]) {
+				col = value_col;
+				error = "Value out of range";
+				break;
+			}
+			values[value_count++] = value;
+
+			skip_space();
+			if(col == line.size()) {
+				if(value_count < 5) {
+					error = "Too few values (expected 5)";
+				}
+				break;
+			}
+			if(line[col] != ',') {
+				error = "Expected a comma";
+				break;
+			}
+			++col;
+		}
+
+		if(error != nullptr) {
+			std::cerr << def_file << ":" << line_no << ":" << (col + 1)
+								<< ": Failed to parse sprite definition: " << error << std::endl;
+			continue;
+		}
+
+		SpriteDef tempdef;
+		tempdef.SourceTileX = values[0];
+		tempdef.SourceTileY = values[1];
+		tempdef.SpriteWidth = values[2];
+		tempdef.SpriteHeight = values[3];
+		tempdef.Next = values[4];
+		out.push_back(tempdef);
 	}
 
 	return out;
 }
 
+// reads sprite definitions in either the text or the compiled form
+vector<SpriteDef> parse_sprdef(std::string const &def_file)
+{
+	MappedFile const in{def_file};
+	std::string_view const data{in.view()};
+
+	if(data.size() >= SPRDEF_BIN_HEADER_SIZE &&
+		 std::memcmp(data.data(), SPRDEF_MAGIC, sizeof(SPRDEF_MAGIC)) == 0) {
+		return parse_sprdef_bin(data);
+	}
+	return parse_sprdef_text(def_file, data);
+}
+
+// writes sprite definitions in the compiled form
+void write_sprdef_bin(std::string const &path, vector<SpriteDef> const &defs)
+{
+	std::vector<u8> out(SPRDEF_MAGIC, SPRDEF_MAGIC + sizeof(SPRDEF_MAGIC));
+	out.reserve(SPRDEF_BIN_HEADER_SIZE + (defs.size() * SPRDEF_BIN_ENTRY_SIZE));
+	mdtile::put_long_be(out, (u32)defs.size());
+	for(auto const &this_def : defs) {
+		mdtile::put_word_be(out, (u16)this_def.SourceTileX);
+		mdtile::put_word_be(out, (u16)this_def.SourceTileY);
+		out.push_back(this_def.SpriteWidth);
+		out.push_back(this_def.SpriteHeight);
+		out.push_back(this_def.Next);
+		out.push_back(0);
+	}
+	mdtile::write_file(path, out);
+}
+
 #endif
@@ -0,0 +1,311 @@
+#ifndef SPRITER__SPRITE_COVER_HPP
+#define SPRITER__SPRITE_COVER_HPP
+
+#include "spritedef.hpp"
+#include <algorithm>
+#include <array>
+#include <chrgfx/chrgfx.hpp>
+#include <mdtile/chr_utils.hpp>
+#include <tuple>
+#include <vector>
+
+using namespace chrgfx;
+using namespace mdtile;
+
+/*
+	A hardware sprite is at most 4x4 tiles, so a sprite definition larger than
+	that is treated as the bounding box of a whole frame and split into
+	hardware sprites that cover its non-blank tiles.
+	The VDP draws only so many sprites (and sprite pixels) on each scanline, so
+	besides using as few sprites as possible, the cover keeps down the most
+	sprites and pixels on any one line of the frame.
+*/
+
+// a hardware sprite within a frame, in tiles
+struct CoverPiece {
+	size_t X{0};
+	size_t Y{0};
+	size_t Width{0};
+	size_t Height{0};
+};
+
+// the cost of a cover, compared in the order of the fields
+struct CoverCost {
+	size_t Sprites{0};
+	// most sprites on one line, and most sprite pixels on one line
+	size_t LineSprites{0};
+	size_t LinePixels{0};
+	size_t Tiles{0};
+
+	bool operator<(CoverCost const &other) const
+	{
+		return std::tie(Sprites, LineSprites, LinePixels, Tiles) <
+					 std::tie(other.Sprites, other.LineSprites, other.LinePixels,
+										other.Tiles);
+	}
+
+	// the cost of two covers that share no lines (bands of a frame, or separate
+	// frames), so the per line loads are the larger of the two; pieces side by
+	// side on the same lines must be costed together (see BandLoad)
+	CoverCost operator+(CoverCost const &other) const
+	{
+		return {Sprites + other.Sprites, std::max(LineSprites, other.LineSprites),
+						std::max(LinePixels, other.LinePixels), Tiles + other.Tiles};
+	}
+};
+
+CoverCost cover_cost(std::vector<CoverPiece> const &pieces, size_t height)
+{
+	CoverCost out;
+	std::vector<size_t> line_sprites(height, 0), line_pixels(height, 0);
+	for(auto const &this_piece : pieces) {
+		++out.Sprites;
+		out.Tiles += this_piece.Width * this_piece.Height;
+		for(size_t this_row{this_piece.Y};
+				this_row < this_piece.Y + this_piece.Height; ++this_row) {
+			++line_sprites[this_row];
+			line_pixels[this_row] += this_piece.Width * 8;
+		}
+	}
+	for(size_t this_row{0}; this_row < height; ++this_row) {
+		out.LineSprites = std::max(out.LineSprites, line_sprites[this_row]);
+		out.LinePixels = std::max(out.LinePixels, line_pixels[this_row]);
+	}
+	return out;
+}
+
+// the pieces of one band (up to 4 rows), with the sprites and pixels they
+// put on each row, as pieces side by side add to the load of the same lines
+struct BandLoad {
+	size_t Sprites{0};
+	size_t Tiles{0};
+	std::array<size_t, 4> RowSprites{};
+	std::array<size_t, 4> RowPixels{};
+
+	// adds a piece whose rows are given from the top of the band
+	void add(size_t row, size_t width, size_t height)
+	{
+		++Sprites;
+		Tiles += width * height;
+		for(size_t this_row{row}; this_row < row + height; ++this_row) {
+			++RowSprites[this_row];
+			RowPixels[this_row] += width * 8;
+		}
+	}
+
+	CoverCost cost() const
+	{
+		return {Sprites, *std::max_element(RowSprites.begin(), RowSprites.end()),
+						*std::max_element(RowPixels.begin(), RowPixels.end()), Tiles};
+	}
+};
+
+/*
+	Covers the non-blank tiles of a frame with pieces laid out in bands of rows
+	mask holds a flag for each tile, row by row. Each band is up to 4 rows
+	tall, and the height of each band is chosen so that the whole frame costs
+	the least, with blank rows between bands skipped. Within a band, pieces up
+	to 4 tiles wide are chosen the same way across the columns (a piece may
+	span blank columns if that saves a sprite), and each piece is trimmed to
+	the rows it has tiles in.
+*/
+std::vector<CoverPiece> cover_bands(std::vector<bool> const &mask,
+																		size_t width, size_t height)
+{
+	auto has_tile = [&](size_t x, size_t y) { return mask[(y * width) + x]; };
+
+	// the best pieces for one band, from its first row and its height
+	auto cover_band = [&](size_t band_y, size_t band_height) {
+		// best[x] is the load of the pieces chosen for columns x and right
+		std::vector<BandLoad> best(width + 1);
+		std::vector<CoverPiece> choice(width);
+		for(size_t this_x{width}; this_x-- > 0;) {
+			bool column_used{false};
+			for(size_t this_y{band_y}; this_y < band_y + band_height; ++this_y) {
+				column_used |= has_tile(this_x, this_y);
+			}
+			if(!column_used) {
+				best[this_x] = best[this_x + 1];
+				choice[this_x] = CoverPiece{};
+				continue;
+			}
+
+			bool first{true};
+			for(size_t this_width{1}; this_width <= 4 && this_x + this_width <= width;
+					++this_width) {
+				// trim the piece to its rows with tiles
+				size_t top{band_y + band_height}, bottom{band_y};
+				for(size_t this_y{band_y}; this_y < band_y + band_height; ++this_y) {
+					for(size_t piece_x{this_x}; piece_x < this_x + this_width;
+							++piece_x) {
+						if(has_tile(piece_x, this_y)) {
+							top = std::min(top, this_y);
+							bottom = std::max(bottom, this_y + 1);
+						}
+					}
+				}
+				CoverPiece const piece{this_x, top, this_width, bottom - top};
+				BandLoad load{best[this_x + this_width]};
+				load.add(top - band_y, piece.Width, piece.Height);
+				if(first || load.cost() < best[this_x].cost()) {
+					best[this_x] = load;
+					choice[this_x] = piece;
+					first = false;
+				}
+			}
+		}
+
+		std::vector<CoverPiece> out;
+		for(size_t this_x{0}; this_x < width;) {
+			if(choice[this_x].Width == 0) {
+				++this_x;
+				continue;
+			}
+			out.push_back(choice[this_x]);
+			this_x += choice[this_x].Width;
+		}
+		return out;
+	};
+
+	// best[y] is the cost of covering rows y and below
+	std::vector<CoverCost> best(height + 1);
+	std::vector<size_t> band_height(height, 0);
+	for(size_t this_y{height}; this_y-- > 0;) {
+		bool row_used{false};
+		for(size_t this_x{0}; this_x < width; ++this_x) {
+			row_used |= has_tile(this_x, this_y);
+		}
+		if(!row_used) {
+			best[this_y] = best[this_y + 1];
+			continue;
+		}
+
+		bool first{true};
+		for(size_t this_height{1}; this_height <= 4 && this_y + this_height <= height;
+				++this_height) {
+			CoverCost const cost{
+					cover_cost(cover_band(this_y, this_height), height) +
+					best[this_y + this_height]};
+			if(first || cost < best[this_y]) {
+				best[this_y] = cost;
+				band_height[this_y] = this_height;
+				first = false;
+			}
+		}
+	}
+
+	std::vector<CoverPiece> out;
+	for(size_t this_y{0}; this_y < height;) {
+		if(band_height[this_y] == 0) {
+			++this_y;
+			continue;
+		}
+		auto const band{cover_band(this_y, band_height[this_y])};
+		out.insert(out.end(), band.begin(), band.end());
+		this_y += band_height[this_y];
+	}
+	return out;
+}
+
+/*
+	Finds the hardware sprites for a frame
+	Bands of rows suit the per line limits best, but tall, narrow frames can
+	need fewer sprites in bands of columns, so both are tried and the cheaper
+	cover is used.
+*/
+std::vector<CoverPiece> cover_frame(std::vector<bool> const &mask, size_t width,
+																		size_t height)
+{
+	auto out{cover_bands(mask, width, height)};
+
+	std::vector<bool> transposed(mask.size());
+	for(size_t this_y{0}; this_y < height; ++this_y) {
+		for(size_t this_x{0}; this_x < width; ++this_x) {
+			transposed[(this_x * height) + this_y] = mask[(this_y * width) + this_x];
+		}
+	}
+	auto by_columns{cover_bands(transposed, height, width)};
+	for(auto &this_piece : by_columns) {
+		std::swap(this_piece.X, this_piece.Y);
+		std::swap(this_piece.Width, this_piece.Height);
+	}
+
+	if(cover_cost(by_columns, height) < cover_cost(out, height)) {
+		out = std::move(by_columns);
+	}
+	return out;
+}
+
+/*
+	Splits each frame larger than a hardware sprite into the pieces that cover
+	it, positioned within the frame
+	Definitions that fit in a hardware sprite are kept as they are. Every
+	definition is a frame of its own, and its pieces are left with its Next
+	value; make_tbl links them in sequence.
+*/
+std::vector<SpriteDef> cover_frames(chrbank const &src_tiles,
+																		std::vector<SpriteDef> const &defs,
+																		unsigned int img_chr_width)
+{
+	std::vector<SpriteDef> out;
+	size_t const img_chr_height{src_tiles.size() / img_chr_width};
+	for(size_t this_frame{0}; this_frame < defs.size(); ++this_frame) {
+		SpriteDef frame{defs[this_frame]};
+		frame.Frame = this_frame;
+
+		size_t const width{frame.SpriteWidth};
+		size_t const height{frame.SpriteHeight};
+		// sprites that already fit, and bad definitions, are left to make_chr
+		if((width <= 4 && height <= 4) || width < 1 || height < 1 ||
+			 frame.SourceTileX + width > img_chr_width ||
+			 frame.SourceTileY + height > img_chr_height) {
+			out.push_back(frame);
+			continue;
+		}
+
+		std::vector<bool> mask(width * height);
+		for(size_t this_y{0}; this_y < height; ++this_y) {
+			for(size_t this_x{0}; this_x < width; ++this_x) {
+				mask[(this_y * width) + this_x] = !is_blank_chr(
+						src_tiles[((frame.SourceTileY + this_y) * img_chr_width) +
+											frame.SourceTileX + this_x]
+								.get());
+			}
+		}
+
+		for(auto const &this_piece : cover_frame(mask, width, height)) {
+			SpriteDef piece{frame};
+			piece.SourceTileX += this_piece.X;
+			piece.SourceTileY += this_piece.Y;
+			piece.SpriteWidth = this_piece.Width;
+			piece.SpriteHeight = this_piece.Height;
+			piece.OffsetX = this_piece.X;
+			piece.OffsetY = this_piece.Y;
+			out.push_back(piece);
+		}
+	}
+	return out;
+}
+
+// the most sprites and sprite pixels on one line of any frame
+CoverCost line_load(std::vector<SpriteDef> const &defs)
+{
+	CoverCost out;
+	for(size_t this_def{0}; this_def < defs.size();) {
+		size_t const frame{defs[this_def].Frame};
+		std::vector<CoverPiece> pieces;
+		size_t height{0};
+		for(; this_def < defs.size() && defs[this_def].Frame == frame; ++this_def) {
+			auto const &piece{defs[this_def]};
+			if(piece.IsValid) {
+				pieces.push_back(CoverPiece{piece.OffsetX, piece.OffsetY,
+																		piece.SpriteWidth, piece.SpriteHeight});
+				height = std::max(height, piece.OffsetY + piece.SpriteHeight);
+			}
+		}
+		out = out + cover_cost(pieces, height);
+	}
+	return out;
+}
+
+#endif
@@ -2,12 +2,27 @@
 #define SPRITER__SPRITE_MAKECHR_HPP
 
 #include "spritedef.hpp"
+#include <algorithm>
 #include <chrgfx/chrgfx.hpp>
+#include <mdtile/chr_utils.hpp>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 using namespace chrgfx;
+using namespace mdtile;
 // when grabbing chrs, need to move vertically then horizontally
 
+/*
+	Builds the list of tiles for the sprite definitions, sharing tiles between
+	sprites wherever the hardware allows
+	A sprite's tiles must be consecutive in VRAM, a column at a time, so each
+	sprite first looks for a run of tiles already in the list that shows it,
+	either as it is or with the sprite flipped (the columns or rows reversed
+	and each tile flipped). If there is none, any tiles at the end of the list
+	that match the start of the sprite are shared and the rest are added.
+	The first tile and the flips of each definition are set for make_tbl.
+*/
 std::vector<u8 *> make_chr(chrbank const &src_tiles,
 													 std::vector<SpriteDef> &defs,
 													 unsigned int img_chr_width)
@@ -15,23 +30,115 @@ std::vector<u8 *> make_chr(chrbank const &src_tiles,
 	// the pointers are managed in the original chrbank, so no worries about leaks
 	// with avector full of pointers
 	std::vector<u8 *> out;
+	// the packed form of each tile in the list, and where each tile occurs
+	std::vector<PackedChr> out_packed;
+	std::unordered_map<PackedChr, std::vector<size_t>, PackedChrHash> positions;
+
+	auto add_tile = [&](u8 *tile, PackedChr const &packed) {
+		positions[packed].push_back(out.size());
+		out.push_back(tile);
+		out_packed.push_back(packed);
+	};
+
+	// finds a run of tiles in the list, returning where it starts
+	auto find_run =
+			[&](std::vector<PackedChr> const &run) -> std::optional<size_t> {
+		auto const first{positions.find(run.front())};
+		if(first == positions.end()) {
+			return std::nullopt;
+		}
+		for(auto const this_start : first->second) {
+			if(this_start + run.size() <= out.size() &&
+				 std::equal(run.begin(), run.end(), out_packed.begin() + this_start)) {
+				return this_start;
+			}
+		}
+		return std::nullopt;
+	};
+
+	size_t const img_chr_height{src_tiles.size() / img_chr_width};
+	std::vector<u8 *> sprite_tiles;
+	std::vector<PackedChr> sprite_packed, stored;
 	for(auto &this_def : defs) {
-		if(this_def.SpriteWidth > 4 || this_def.SpriteHeight > 4) {
+		if(this_def.SourceTileX + this_def.SpriteWidth > img_chr_width ||
+			 this_def.SourceTileY + this_def.SpriteHeight > img_chr_height) {
+			std::cerr << "Invalid position for def at tile " << this_def.SourceTileX
+								<< "/" << this_def.SourceTileY
+								<< " - Sprite extends past the edge of the image" << std::endl;
+			this_def.IsValid = false;
+			continue;
+		}
+		if(this_def.SpriteWidth < 1 || this_def.SpriteHeight < 1 ||
+			 this_def.SpriteWidth > 4 || this_def.SpriteHeight > 4) {
 			std::cerr << "Invalid size for def at tile " << this_def.SourceTileX
 								<< "/" << this_def.SourceTileY
-								<< " - Sprite width/height may only be 4 tiles max";
+								<< " - Sprite width/height may only be 4 tiles max"
+								<< std::endl;
 			this_def.IsValid = false;
 			continue;
 		}
 
+		size_t const width{this_def.SpriteWidth};
+		size_t const height{this_def.SpriteHeight};
 		size_t chr_offset{(this_def.SourceTileY * img_chr_width) +
 											this_def.SourceTileX};
-		for(int h_iter{0}; h_iter < this_def.SpriteWidth; ++h_iter) {
-			for(int v_iter{0}; v_iter < this_def.SpriteHeight; ++v_iter) {
-				out.push_back(
-						src_tiles[chr_offset + (img_chr_width * v_iter) + h_iter].get());
+		sprite_tiles.clear();
+		sprite_packed.clear();
+		for(size_t h_iter{0}; h_iter < width; ++h_iter) {
+			for(size_t v_iter{0}; v_iter < height; ++v_iter) {
+				u8 *tile{
+						src_tiles[chr_offset + (img_chr_width * v_iter) + h_iter].get()};
+				sprite_tiles.push_back(tile);
+				sprite_packed.push_back(pack_chr(tile));
 			}
 		}
+
+		// look for the sprite as it is, then flipped h, v and hv
+		bool found{false};
+		for(int this_flip{0}; this_flip < 4 && !found; ++this_flip) {
+			bool const hflip{(this_flip & 1) != 0};
+			bool const vflip{(this_flip & 2) != 0};
+			// the tiles as they must be stored to show the sprite with this flip
+			stored.assign(sprite_packed.size(), PackedChr{});
+			for(size_t h_iter{0}; h_iter < width; ++h_iter) {
+				for(size_t v_iter{0}; v_iter < height; ++v_iter) {
+					PackedChr tile{sprite_packed[(h_iter * height) + v_iter]};
+					if(hflip) {
+						hflip_chr(tile);
+					}
+					if(vflip) {
+						vflip_chr(tile);
+					}
+					size_t const stored_h{hflip ? width - 1 - h_iter : h_iter};
+					size_t const stored_v{vflip ? height - 1 - v_iter : v_iter};
+					stored[(stored_h * height) + stored_v] = tile;
+				}
+			}
+
+			auto const start{find_run(stored)};
+			if(start) {
+				this_def.TileIndex = start.value();
+				this_def.HFlip = hflip;
+				this_def.VFlip = vflip;
+				found = true;
+			}
+		}
+		if(found) {
+			continue;
+		}
+
+		// share the tiles at the end of the list that start this sprite
+		size_t overlap{std::min(sprite_packed.size() - 1, out.size())};
+		while(overlap > 0 &&
+					!std::equal(sprite_packed.begin(), sprite_packed.begin() + overlap,
+											out_packed.end() - overlap)) {
+			--overlap;
+		}
+		this_def.TileIndex = out.size() - overlap;
+		for(size_t this_tile{overlap}; this_tile < sprite_tiles.size();
+				++this_tile) {
+			add_tile(sprite_tiles[this_tile], sprite_packed[this_tile]);
+		}
 	}
 
 	return out;
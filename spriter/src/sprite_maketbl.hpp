@@ -8,29 +8,84 @@
 
 using namespace chrgfx;
 
+/*
+	Builds the sprite table, one entry for each valid definition
+	The pieces of a split frame (see cover_frames) are linked in sequence: each
+	links to the entry after it, by its index in this table, and the last keeps
+	the Next of its definition. An engine that copies a frame elsewhere in the
+	sprite attribute table must offset those links by the frame's new position
+	less its first entry here (from the frame table).
+*/
 std::vector<std::array<u16, 4>> make_tbl(std::vector<SpriteDef> const &defs,
 																				 u16 base_tile = 0)
 {
 	std::vector<std::array<u16, 4>> out;
-	u16 tile_offset{base_tile};
-	for(auto const &this_def : defs) {
+	for(size_t this_idx{0}; this_idx < defs.size(); ++this_idx) {
+		auto const &this_def{defs[this_idx]};
 		if(!this_def.IsValid) {
 			continue;
 		}
 
+		// the next valid entry of the same frame, if any
+		bool linked{false};
+		for(size_t next_idx{this_idx + 1};
+				next_idx < defs.size() && defs[next_idx].Frame == this_def.Frame;
+				++next_idx) {
+			if(defs[next_idx].IsValid) {
+				linked = true;
+				break;
+			}
+		}
+
 		std::array<u16, 4> def{0, 0, 0, 0};
+		// y in idx 0
 		// next & hs/vs in idx 1
-		// gfx in idx 2
-		// others are 0
-		def[1] = this_def.Next;
-		u8 test1 = def[1] |=
+		// gfx & flips in idx 2
+		// x in idx 3
+		// positions are relative to the top left of the frame
+		def[0] = (u16)(this_def.OffsetY * 8);
+		def[1] = linked ? (u8)(out.size() + 1) : this_def.Next;
+		def[1] |=
 				((((this_def.SpriteWidth - 1) << 2) | (this_def.SpriteHeight - 1))
 				 << 8);
-		def[2] = tile_offset;
-		tile_offset += (this_def.SpriteHeight * this_def.SpriteWidth) + base_tile;
+		def[2] = (u16)((base_tile + this_def.TileIndex) & 0x7ff);
+		if(this_def.HFlip) {
+			def[2] |= 0x800;
+		}
+		if(this_def.VFlip) {
+			def[2] |= 0x1000;
+		}
+		def[3] = (u16)(this_def.OffsetX * 8);
 		out.push_back(def);
 	}
 
 	return out;
 }
+
+/*
+	Builds the frame table: for each frame, the index of its first entry in the
+	sprite table and the number of entries
+	A frame with no valid entries (or no tiles) has a count of 0.
+*/
+std::vector<std::array<u16, 2>>
+make_frame_tbl(std::vector<SpriteDef> const &defs, size_t frame_count)
+{
+	std::vector<std::array<u16, 2>> out;
+	u16 entry{0};
+	for(auto const &this_def : defs) {
+		while(out.size() <= this_def.Frame) {
+			out.push_back({entry, 0});
+		}
+		if(!this_def.IsValid) {
+			continue;
+		}
+		++out[this_def.Frame][1];
+		++entry;
+	}
+	while(out.size() < frame_count) {
+		out.push_back({entry, 0});
+	}
+
+	return out;
+}
 #endif
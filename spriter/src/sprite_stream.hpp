@@ -0,0 +1,143 @@
+#ifndef SPRITER__SPRITE_STREAM_HPP
+#define SPRITER__SPRITE_STREAM_HPP
+
+#include "sprite_makechr.hpp"
+#include "spritedef.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace chrgfx;
+using namespace mdtile;
+
+/*
+	Streamed sprite tiles
+	Instead of loading every tile once, a game can keep one slot in VRAM for a
+	sprite and copy in the tiles of the current frame by DMA during vblank. For
+	that, each frame's tiles are laid out together (with tiles shared only
+	within the frame, or with an earlier frame that has exactly the same
+	tiles), and the sprite entries of every frame point into the slot.
+	DMA cannot cross a 128 KiB boundary in its source, so a frame that would
+	is moved up to the next boundary, assuming the tiles are placed at a
+	128 KiB aligned address (or at least so that no boundary falls inside
+	them).
+*/
+
+// bytes per tile, the DMA source boundary and the size of VRAM
+constexpr size_t STREAM_TILE_SIZE{32};
+constexpr size_t DMA_BOUNDARY{0x20000};
+constexpr size_t VRAM_SIZE{0x10000};
+
+// a DMA copy from the tiles to VRAM
+struct DmaTransfer {
+	// offset in the tile data, in bytes
+	u32 Source{0};
+	// length in words, as given to the VDP; 0 for a frame with no tiles, which
+	// must be skipped rather than started, as the VDP takes a length of 0 as
+	// 0x10000 words (no real transfer is that long, as VRAM is half that)
+	u16 Length{0};
+	// VRAM address, in bytes
+	u16 Dest{0};
+};
+
+struct StreamChr {
+	std::vector<u8 *> Tiles;
+	// one per frame
+	std::vector<DmaTransfer> Transfers;
+	// the blank tile used to pad up to a DMA boundary
+	std::vector<u8> Padding;
+};
+
+/*
+	Builds the tiles for streaming, with the transfer for each frame
+	The tile index of each definition is relative to the start of the slot,
+	which is at base_tile in VRAM. Frames needing more than budget bytes in
+	one transfer are reported. Frames with no tiles get a transfer with a
+	Length (and Source) of 0, meaning there is nothing to copy.
+	Throws invalid_argument if the slot starts past the end of VRAM, and
+	runtime_error if a frame would run past it.
+*/
+StreamChr make_stream_chr(chrbank const &src_tiles, std::vector<SpriteDef> &defs,
+													unsigned int img_chr_width, size_t frame_count,
+													u16 base_tile, size_t budget)
+{
+	size_t const slot{(size_t)base_tile * STREAM_TILE_SIZE};
+	if(slot >= VRAM_SIZE) {
+		throw std::invalid_argument("Base tile " + std::to_string(base_tile) +
+																" is past the end of VRAM");
+	}
+
+	StreamChr out;
+	out.Padding.resize(64, 0);
+	out.Transfers.resize(frame_count);
+
+	size_t this_def{0};
+	for(size_t this_frame{0}; this_frame < frame_count; ++this_frame) {
+		DmaTransfer &transfer{out.Transfers[this_frame]};
+		transfer.Dest = (u16)slot;
+
+		// the defs are grouped by frame, so each frame is built on its own
+		size_t const first_def{this_def};
+		while(this_def < defs.size() && defs[this_def].Frame == this_frame) {
+			++this_def;
+		}
+		std::vector<SpriteDef> frame_defs(defs.begin() + first_def,
+																			defs.begin() + this_def);
+		auto const frame_tiles{make_chr(src_tiles, frame_defs, img_chr_width)};
+		std::copy(frame_defs.begin(), frame_defs.end(), defs.begin() + first_def);
+		// no tiles: the transfer is left at length 0, for no transfer
+		if(frame_tiles.empty()) {
+			continue;
+		}
+
+		size_t const frame_size{frame_tiles.size() * STREAM_TILE_SIZE};
+		if(slot + frame_size > VRAM_SIZE) {
+			throw std::runtime_error(
+					"Frame " + std::to_string(this_frame) + " needs " +
+					std::to_string(frame_size) + " bytes, which runs past the end of " +
+					"VRAM from base tile " + std::to_string(base_tile));
+		}
+		if(frame_size > budget) {
+			std::cerr << "Warning: frame " << this_frame << " needs " << frame_size
+								<< " bytes of DMA, over the budget of " << budget << " bytes"
+								<< std::endl;
+		}
+		transfer.Length = (u16)(frame_size / 2);
+
+		// reuse an earlier frame with the same tiles
+		bool found{false};
+		for(size_t prev_frame{0}; prev_frame < this_frame && !found;
+				++prev_frame) {
+			auto const &prev{out.Transfers[prev_frame]};
+			if(prev.Length != transfer.Length) {
+				continue;
+			}
+			size_t const prev_tile{prev.Source / STREAM_TILE_SIZE};
+			found = std::equal(frame_tiles.begin(), frame_tiles.end(),
+												 out.Tiles.begin() + prev_tile,
+												 [](u8 const *a, u8 const *b) {
+													 return is_identical_chr(a, b);
+												 });
+			if(found) {
+				transfer.Source = prev.Source;
+			}
+		}
+		if(found) {
+			continue;
+		}
+
+		size_t start{out.Tiles.size() * STREAM_TILE_SIZE};
+		if((start / DMA_BOUNDARY) != ((start + frame_size - 1) / DMA_BOUNDARY)) {
+			size_t const boundary{((start / DMA_BOUNDARY) + 1) * DMA_BOUNDARY};
+			out.Tiles.resize(boundary / STREAM_TILE_SIZE, out.Padding.data());
+			start = boundary;
+		}
+		transfer.Source = (u32)start;
+		out.Tiles.insert(out.Tiles.end(), frame_tiles.begin(), frame_tiles.end());
+	}
+
+	return out;
+}
+
+#endif
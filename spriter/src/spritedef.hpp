@@ -10,6 +10,16 @@ struct SpriteDef {
 	u8 SpriteHeight{0};
 	u8 Next{0};
 	bool IsValid{true};
+	// the frame (line in the sprdef file) the sprite belongs to, and its
+	// position within the frame in tiles
+	size_t Frame{0};
+	size_t OffsetX{0};
+	size_t OffsetY{0};
+	// set by make_chr: the sprite's first tile in the output, and the flips
+	// that make the tiles there show it
+	size_t TileIndex{0};
+	bool HFlip{false};
+	bool VFlip{false};
 };
 
 #endif
\ No newline at end of file
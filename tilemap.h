@@ -8,6 +8,12 @@
 
 #include "types.h"
 
+/**
+ * Settings for load_tilemap: the palette line and priority of every entry
+ * and the tile added to each tile index
+ * In tilemaps with palette line entries (tileopt --palette-lines), the
+ * palette line here is replaced by each palette line entry.
+ */
 #define TILEMAP_SETTINGS(palette_line, priority, base_tile)     \
   ((base_tile & 0x07FF) << 16) | ((palette_line & 0x3) << 13) | \
       ((priority & 0x1) << 15)
@@ -33,6 +33,11 @@
  *  D0 - word- vram offset to place the tilemap
  *  D1 - byte - tiles per row
  *  D2 - long (split) - upper: base tile, lower: priority/palette settings (upper three bits of word, should be prepared!)
+ *
+ * A blank run entry with the v bit also set (0x3000 | line) is a palette line
+ * entry: it draws nothing, and the palette line in its low two bits replaces
+ * the one from D2 for the rest of the tilemap. tileopt writes these for maps
+ * made with --palette-lines.
 */
 FUNC load_tilemap
 	PUSHM d0-d7
@@ -99,6 +104,9 @@ FUNC load_tilemap
 	cmp.w #0x2000, d6
 	# no, not a blank run
 	bne 7f
+	# blank run bit with the v bit set is a palette line entry
+	btst #12, d4
+	bne 6f
 	# yes, get the count of blanks
 	move.w d4, d3
 	and.w #0x07ff, d3
@@ -108,6 +116,17 @@ FUNC load_tilemap
 	moveq #0, d4
 	bra 9f
 
+6:# palette line entry, the line is in the low two bits
+	# clear the palette bits from the settings
+	and.w #0x9fff, d2
+	# and put in the new line for the entries that follow
+	move.w d4, d6
+	and.w #0x3, d6
+	ror.w #3, d6
+	or.w d6, d2
+	# nothing to draw, get the next entry
+	bra 5b
+
 7:# tile run bits set, shift them down 
 	lsr.w #8, d6
 	lsr.w #5, d6
@@ -220,6 +239,9 @@ FUNC clear_tilemap
 	cmp.w #0x2000, d6
 	# no, not a blank run
 	bne 7f
+	# palette line entries draw nothing, get the next entry
+	btst #12, d4
+	bne 5b
 	# yes, get the count of blanks
 	move.w d4, d3
 	and.w #0x07ff, d3
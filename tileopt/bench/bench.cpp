@@ -0,0 +1,414 @@
+/*
+ tileopt_bench
+  Microbenchmarks for the tileopt hot paths, run over synthetic tile banks
+  Results are written to stdout as JSON
+*/
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mdtile/chr_kernels.hpp>
+#include <mdtile/chr_utils.hpp>
+#include <mdtile/md_gfx.hpp>
+#include <mdtile/tilemap.hpp>
+#include <mdtile/tilemap_sim.hpp>
+#include <mdtile/thread_pool.hpp>
+#include <mdtile/tileopt.hpp>
+#include <mdtile/types.hpp>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mdtile;
+
+/*
+  Allocation tracking
+*/
+std::atomic<size_t> allocated_bytes{0};
+
+// these are kept out of line so that the compiler cannot pair the malloc
+// in operator new with the free in operator delete and warn of a mismatch
+[[gnu::noinline]] void* tracked_alloc(size_t size, size_t align) {
+  allocated_bytes += size;
+  size = size ? size : 1;
+  void* ptr{align <= alignof(std::max_align_t)
+                ? std::malloc(size)
+                : std::aligned_alloc(align, ((size + align - 1) / align) * align)};
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+[[gnu::noinline]] void tracked_free(void* ptr) noexcept { std::free(ptr); }
+
+void* operator new(size_t size) { return tracked_alloc(size, 0); }
+void* operator new[](size_t size) { return tracked_alloc(size, 0); }
+void* operator new(size_t size, std::align_val_t align) {
+  return tracked_alloc(size, (size_t)align);
+}
+void* operator new[](size_t size, std::align_val_t align) {
+  return tracked_alloc(size, (size_t)align);
+}
+void operator delete(void* ptr) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  tracked_free(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  tracked_free(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  tracked_free(ptr);
+}
+
+struct bench_config {
+  size_t tiles{65536};
+  // fraction of tiles that are blank / flat
+  double blank_ratio{0.1};
+  double flat_ratio{0.05};
+  // fraction of the remaining (normal) tiles that repeat an earlier tile
+  double dupe_ratio{0.5};
+  // fraction of those repeats that are flipped
+  double flip_ratio{0.25};
+  unsigned int iterations{5};
+  unsigned int jobs{1};
+  unsigned int seed{1};
+};
+
+struct bench_result {
+  std::string name;
+  double ns_per_tile;
+  size_t bytes_allocated;
+};
+
+int process_args(bench_config& cfg, int argc, char** argv);
+
+// builds a synthetic tile bank according to the config
+TileStore make_bank(bench_config const& cfg) {
+  std::mt19937 rng{cfg.seed};
+  std::uniform_real_distribution<double> chance{0.0, 1.0};
+  std::uniform_int_distribution<int> pixel{0, 15};
+
+  TileStore bank;
+  bank.reserve(cfg.tiles);
+  std::vector<size_t> normal_tiles;
+
+  for (size_t this_tile{0}; this_tile < cfg.tiles; ++this_tile) {
+    std::unique_ptr<u8[]> tile{new u8[CHR_BYTESIZE]};
+    double const kind{chance(rng)};
+
+    if (kind < cfg.blank_ratio) {
+      std::fill(tile.get(), tile.get() + CHR_BYTESIZE, 0);
+    } else if (kind < cfg.blank_ratio + cfg.flat_ratio) {
+      std::fill(tile.get(), tile.get() + CHR_BYTESIZE, (u8)(1 + (rng() % 15)));
+    } else if (!normal_tiles.empty() && chance(rng) < cfg.dupe_ratio) {
+      u8 const* source{bank[normal_tiles[rng() % normal_tiles.size()]].get()};
+      std::copy(source, source + CHR_BYTESIZE, tile.get());
+      if (chance(rng) < cfg.flip_ratio) {
+        int const flip{1 + (int)(rng() % 3)};
+        if (flip & 1) {
+          CHR_KERNELS_SCALAR.HFlip(tile.get());
+        }
+        if (flip & 2) {
+          CHR_KERNELS_SCALAR.VFlip(tile.get());
+        }
+      }
+    } else {
+      for (size_t this_pxl{0}; this_pxl < CHR_BYTESIZE; ++this_pxl) {
+        tile[this_pxl] = (u8)pixel(rng);
+      }
+      normal_tiles.push_back(this_tile);
+    }
+    bank.push_back(std::move(tile));
+  }
+
+  return bank;
+}
+
+// runs the work the configured number of times and reports the median time
+// per tile, along with the bytes allocated by a single run
+bench_result measure(std::string const& name, bench_config const& cfg,
+                     size_t tile_count, std::function<void()> const& work) {
+  std::vector<double> timings;
+  size_t bytes{0};
+  for (unsigned int this_iter{0}; this_iter < cfg.iterations; ++this_iter) {
+    size_t const bytes_before{allocated_bytes};
+    auto const start{std::chrono::steady_clock::now()};
+    work();
+    auto const elapsed{std::chrono::steady_clock::now() - start};
+    bytes = allocated_bytes - bytes_before;
+    timings.push_back(
+        std::chrono::duration<double, std::nano>(elapsed).count());
+  }
+  std::sort(timings.begin(), timings.end());
+  return bench_result{name, timings[timings.size() / 2] / tile_count, bytes};
+}
+
+// keeps the compiler from discarding results
+volatile size_t sink;
+
+int main(int argc, char** argv) {
+  bench_config cfg;
+  try {
+    int process_args_result{process_args(cfg, argc, argv)};
+    if (process_args_result < 1) {
+      return process_args_result;
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "Invalid argument: " << e.what() << std::endl;
+    return -5;
+  }
+
+  TileStore bank{make_bank(cfg)};
+  std::vector<u8*> tile_ptrs;
+  for (auto const& this_tile : bank) {
+    tile_ptrs.push_back(this_tile.get());
+  }
+
+  ThreadPool pool{cfg.jobs};
+  std::vector<bench_result> results;
+
+  // pipeline stages
+  TileOptMap opt_tiles;
+  results.push_back(measure("optimize_tiles", cfg, bank.size(), [&] {
+    opt_tiles = optimize_tiles(tile_ptrs, &pool);
+  }));
+
+  std::vector<u8*> final_tiles;
+  results.push_back(measure("make_tile_list", cfg, bank.size(), [&] {
+    final_tiles = make_tile_list(opt_tiles);
+  }));
+
+  std::vector<TilemapEntry> tilemap;
+  results.push_back(measure("optimize_tilemap", cfg, bank.size(), [&] {
+    tilemap = optimize_tilemap(opt_tiles.Cells);
+  }));
+
+  results.push_back(measure("make_tilemap_list", cfg, bank.size(), [&] {
+    sink = make_tilemap_list(tilemap, 0, 64).size();
+  }));
+
+  results.push_back(measure("simulate_load_tilemap", cfg, bank.size(), [&] {
+    sink = simulate_load_tilemap(make_tilemap_list(tilemap, 0, 64)).Cycles;
+  }));
+
+  // decode cost of each tilemap encoding, from the simulated load_tilemap
+  struct encoding_result {
+    std::string name;
+    size_t words;
+    size_t load_cycles;
+    size_t clear_cycles;
+  };
+  std::vector<encoding_result> encodings;
+  auto add_encoding = [&](std::string const& name,
+                          std::vector<TilemapEntry> const& encoded) {
+    auto const list{make_tilemap_list(encoded, 0, 64)};
+    encodings.push_back({name, list.size(),
+                         simulate_load_tilemap(list).Cycles,
+                         simulate_clear_tilemap(list).Cycles});
+  };
+  add_encoding("none", optimize_tilemap(opt_tiles.Cells, true));
+  add_encoding("greedy", tilemap);
+
+  results.push_back(measure("pack_md_chr_list", cfg, final_tiles.size(), [&] {
+    sink = pack_md_chr_list(final_tiles).size();
+  }));
+
+  results.push_back(measure("pack_chr", cfg, bank.size(), [&] {
+    u32 acc{0};
+    for (auto const this_tile : tile_ptrs) {
+      acc ^= pack_chr(this_tile).Rows[0];
+    }
+    sink = acc;
+  }));
+
+  // tile kernels, for each implementation available
+  std::vector<ChrKernels> kernel_sets{CHR_KERNELS_SCALAR};
+#ifdef MDTILE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    kernel_sets.push_back(CHR_KERNELS_SSE2);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernel_sets.push_back(CHR_KERNELS_AVX2);
+  }
+#endif
+
+  // RGB copies of the tiles for the color distance kernel, using an
+  // arbitrary palette
+  std::vector<u8> palette_rgb(256 * 3);
+  for (size_t this_byte{0}; this_byte < palette_rgb.size(); ++this_byte) {
+    palette_rgb[this_byte] = (u8)(this_byte * 37);
+  }
+  std::vector<u8> rgb_tiles(tile_ptrs.size() * RGB_CHR_BYTESIZE);
+  for (size_t this_tile{0}; this_tile < tile_ptrs.size(); ++this_tile) {
+    make_rgb_chr(tile_ptrs[this_tile], palette_rgb.data(),
+                 rgb_tiles.data() + (this_tile * RGB_CHR_BYTESIZE));
+  }
+
+  std::vector<u8> scratch(CHR_BYTESIZE);
+  for (auto const& kernels : kernel_sets) {
+    std::string const suffix{std::string{"/"} + kernels.Name};
+    results.push_back(
+        measure("is_blank_chr" + suffix, cfg, tile_ptrs.size(), [&] {
+          size_t count{0};
+          for (auto const this_tile : tile_ptrs) {
+            count += kernels.IsBlank(this_tile);
+          }
+          sink = count;
+        }));
+    results.push_back(
+        measure("is_flat_chr" + suffix, cfg, tile_ptrs.size(), [&] {
+          size_t count{0};
+          for (auto const this_tile : tile_ptrs) {
+            count += kernels.IsFlat(this_tile);
+          }
+          sink = count;
+        }));
+    results.push_back(
+        measure("is_identical_chr" + suffix, cfg, tile_ptrs.size(), [&] {
+          size_t count{0};
+          for (size_t this_tile{1}; this_tile < tile_ptrs.size();
+               ++this_tile) {
+            count += kernels.IsIdentical(tile_ptrs[this_tile - 1],
+                                         tile_ptrs[this_tile]);
+          }
+          sink = count;
+        }));
+    results.push_back(measure("hflip_chr" + suffix, cfg, tile_ptrs.size(), [&] {
+      for (auto const this_tile : tile_ptrs) {
+        std::copy(this_tile, this_tile + CHR_BYTESIZE, scratch.data());
+        kernels.HFlip(scratch.data());
+      }
+      sink = scratch[0];
+    }));
+    results.push_back(measure("vflip_chr" + suffix, cfg, tile_ptrs.size(), [&] {
+      for (auto const this_tile : tile_ptrs) {
+        std::copy(this_tile, this_tile + CHR_BYTESIZE, scratch.data());
+        kernels.VFlip(scratch.data());
+      }
+      sink = scratch[0];
+    }));
+    results.push_back(
+        measure("color_distance_chr" + suffix, cfg, tile_ptrs.size(), [&] {
+          size_t total{0};
+          for (size_t this_tile{1}; this_tile < tile_ptrs.size();
+               ++this_tile) {
+            total += kernels.ColorDistance(
+                rgb_tiles.data() + ((this_tile - 1) * RGB_CHR_BYTESIZE),
+                rgb_tiles.data() + (this_tile * RGB_CHR_BYTESIZE));
+          }
+          sink = total;
+        }));
+  }
+
+  // report
+  std::cout << "{\n"
+            << "  \"config\": {\"tiles\": " << cfg.tiles
+            << ", \"blank_ratio\": " << cfg.blank_ratio
+            << ", \"flat_ratio\": " << cfg.flat_ratio
+            << ", \"dupe_ratio\": " << cfg.dupe_ratio
+            << ", \"flip_ratio\": " << cfg.flip_ratio
+            << ", \"iterations\": " << cfg.iterations
+            << ", \"jobs\": " << cfg.jobs << ", \"seed\": " << cfg.seed
+            << ", \"kernels\": \"" << chr_kernels.Name << "\"},\n"
+            << "  \"unique_tiles\": " << final_tiles.size() << ",\n"
+            << "  \"results\": [\n";
+  for (size_t this_result{0}; this_result < results.size(); ++this_result) {
+    auto const& result{results[this_result]};
+    std::cout << "    {\"name\": \"" << result.name
+              << "\", \"ns_per_tile\": " << result.ns_per_tile
+              << ", \"tiles_per_sec\": "
+              << (result.ns_per_tile > 0 ? 1e9 / result.ns_per_tile : 0)
+              << ", \"bytes_allocated\": " << result.bytes_allocated << "}"
+              << (this_result + 1 < results.size() ? "," : "") << "\n";
+  }
+  std::cout << "  ],\n  \"tilemaps\": [\n";
+  for (size_t this_encoding{0}; this_encoding < encodings.size();
+       ++this_encoding) {
+    auto const& encoding{encodings[this_encoding]};
+    std::cout << "    {\"encoding\": \"" << encoding.name
+              << "\", \"words\": " << encoding.words
+              << ", \"load_cycles\": " << encoding.load_cycles
+              << ", \"clear_cycles\": " << encoding.clear_cycles << "}"
+              << (this_encoding + 1 < encodings.size() ? "," : "") << "\n";
+  }
+  std::cout << "  ]\n}" << std::endl;
+
+  return 0;
+}
+
+int process_args(bench_config& cfg, int argc, char** argv) {
+  std::string short_opts{":n:b:f:d:F:i:j:s:h"};
+  std::vector<option> long_opts{
+      {"tiles", required_argument, nullptr, 'n'},
+      {"blank-ratio", required_argument, nullptr, 'b'},
+      {"flat-ratio", required_argument, nullptr, 'f'},
+      {"dupe-ratio", required_argument, nullptr, 'd'},
+      {"flip-ratio", required_argument, nullptr, 'F'},
+      {"iterations", required_argument, nullptr, 'i'},
+      {"jobs", required_argument, nullptr, 'j'},
+      {"seed", required_argument, nullptr, 's'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  while (true) {
+    const auto this_opt =
+        getopt_long(argc, argv, short_opts.data(), long_opts.data(), nullptr);
+    if (this_opt == -1) break;
+
+    switch (this_opt) {
+      case 'n':
+        cfg.tiles = std::max(std::stoul(optarg), 1ul);
+        break;
+      case 'b':
+        cfg.blank_ratio = std::stod(optarg);
+        break;
+      case 'f':
+        cfg.flat_ratio = std::stod(optarg);
+        break;
+      case 'd':
+        cfg.dupe_ratio = std::stod(optarg);
+        break;
+      case 'F':
+        cfg.flip_ratio = std::stod(optarg);
+        break;
+      case 'i':
+        cfg.iterations = std::max(std::stoi(optarg), 1);
+        break;
+      case 'j':
+        cfg.jobs = std::max(std::stoi(optarg), 1);
+        break;
+      case 's':
+        cfg.seed = std::stoul(optarg);
+        break;
+
+      case 'h':
+        std::cout << "tileopt_bench [--tiles N] [--blank-ratio R] "
+                     "[--flat-ratio R] [--dupe-ratio R] [--flip-ratio R] "
+                     "[--iterations N] [--jobs N] [--seed N]"
+                  << std::endl;
+        return 0;
+
+      case ':':
+        std::cerr << "Missing arg for option: " << std::to_string(optopt)
+                  << std::endl;
+        return 0;
+      case '?':
+        std::cerr << "Unknown argument" << std::endl;
+        return -1;
+    }
+  }
+
+  return 1;
+}
@@ -0,0 +1,229 @@
+#ifndef TILEMAP__BUILD_CACHE_H
+#define TILEMAP__BUILD_CACHE_H
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <chrgfx/chrgfx.hpp>
+
+#include "tiletypes.hpp"
+
+using namespace chrgfx;
+
+/*
+  128 bit FNV-1a, used to key the build cache
+  (not cryptographic, but collisions between real assets are not a concern)
+*/
+class ContentHash {
+ public:
+  void update(void const* data, size_t length) {
+    u8 const* bytes{(u8 const*)data};
+    for (size_t this_byte{0}; this_byte < length; ++this_byte) {
+      m_hash ^= bytes[this_byte];
+      m_hash *= FNV_PRIME;
+    }
+  }
+
+  template <typename T>
+  void update_value(T const& value) {
+    update(&value, sizeof(T));
+  }
+
+  void update_string(std::string const& value) {
+    update_value(value.size());
+    update(value.data(), value.size());
+  }
+
+  std::string hex() const {
+    std::ostringstream out;
+    out << std::hex << std::setfill('0') << std::setw(16)
+        << (uint64_t)(m_hash >> 64) << std::setw(16) << (uint64_t)m_hash;
+    return out.str();
+  }
+
+ private:
+  static constexpr unsigned __int128 FNV_PRIME{
+      ((unsigned __int128)0x0000000001000000 << 64) | 0x000000000000013b};
+  unsigned __int128 m_hash{((unsigned __int128)0x6c62272e07bb0142 << 64) |
+                           0x62b821756295c58d};
+};
+
+/*
+  Content addressed cache of conversion results
+  Each entry is a single file named for its key. Entries are written to a
+  temporary file and renamed into place, so parallel builds sharing the
+  directory only ever see complete entries. Entries are touched when used and
+  the least recently used are evicted once the directory grows past its size
+  limit.
+*/
+class BuildCache {
+ public:
+  BuildCache(std::string const& dir, uintmax_t max_size)
+      : m_dir{dir}, m_max_size{max_size} {
+    std::filesystem::create_directories(m_dir);
+  }
+
+  std::optional<ConvertOutput> load(std::string const& key) const {
+    auto const entry_path{path_for(key)};
+    std::ifstream in{entry_path, std::ios::binary};
+    if (!in.good()) {
+      return std::nullopt;
+    }
+
+    char magic[sizeof(ENTRY_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in.good() || !std::equal(magic, magic + sizeof(magic), ENTRY_MAGIC)) {
+      return std::nullopt;
+    }
+
+    ConvertOutput entry;
+    entry.InputTiles = read_u64(in);
+    entry.OutputTiles = read_u64(in);
+    if (!read_blob(in, entry.Chr) || !read_blob(in, entry.Map) ||
+        !read_blob(in, entry.Pal)) {
+      return std::nullopt;
+    }
+
+    // mark as recently used; another process may have evicted it by now,
+    // which is fine since we already have the data
+    std::error_code ec;
+    std::filesystem::last_write_time(
+        entry_path, std::filesystem::file_time_type::clock::now(), ec);
+
+    return entry;
+  }
+
+  void store(std::string const& key, ConvertOutput const& entry) const {
+    auto const entry_path{path_for(key)};
+    auto const temp_path{entry_path.string() + ".tmp" + unique_suffix()};
+    {
+      std::ofstream out{temp_path, std::ios::binary};
+      out.write(ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+      write_u64(out, entry.InputTiles);
+      write_u64(out, entry.OutputTiles);
+      write_blob(out, entry.Chr);
+      write_blob(out, entry.Map);
+      write_blob(out, entry.Pal);
+      if (!out.good()) {
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        return;
+      }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, entry_path, ec);
+    if (ec) {
+      std::filesystem::remove(temp_path, ec);
+      return;
+    }
+
+    evict();
+  }
+
+ private:
+  static constexpr char ENTRY_MAGIC[8]{'T', 'O', 'P', 'T', 'C', 'H', 'E', '1'};
+  static constexpr char const* ENTRY_EXT{".tcache"};
+
+  std::filesystem::path path_for(std::string const& key) const {
+    return m_dir / (key + ENTRY_EXT);
+  }
+
+  // removes the least recently used entries until the cache fits its limit
+  // errors are ignored, as other processes may be evicting at the same time
+  void evict() const {
+    struct cached_file {
+      std::filesystem::path path;
+      std::filesystem::file_time_type last_used;
+      uintmax_t size;
+    };
+    std::vector<cached_file> files;
+    uintmax_t total_size{0};
+
+    std::error_code ec;
+    for (auto const& this_entry :
+         std::filesystem::directory_iterator(m_dir, ec)) {
+      if (this_entry.path().extension() != ENTRY_EXT) {
+        continue;
+      }
+      cached_file this_file{this_entry.path(), this_entry.last_write_time(ec),
+                            this_entry.file_size(ec)};
+      if (ec) {
+        continue;
+      }
+      total_size += this_file.size;
+      files.push_back(this_file);
+    }
+
+    if (total_size <= m_max_size) {
+      return;
+    }
+
+    std::sort(files.begin(), files.end(),
+              [](cached_file const& a, cached_file const& b) {
+                return a.last_used < b.last_used;
+              });
+    for (auto const& this_file : files) {
+      if (total_size <= m_max_size) {
+        break;
+      }
+      if (std::filesystem::remove(this_file.path, ec)) {
+        total_size -= this_file.size;
+      }
+    }
+  }
+
+  static std::string unique_suffix() {
+    static thread_local std::mt19937_64 rng{std::random_device{}()};
+    std::ostringstream out;
+    out << std::hex << rng();
+    return out.str();
+  }
+
+  static void write_u64(std::ostream& out, uint64_t value) {
+    u8 bytes[8];
+    for (int this_byte{0}; this_byte < 8; ++this_byte) {
+      bytes[this_byte] = (u8)(value >> (this_byte * 8));
+    }
+    out.write((char const*)bytes, 8);
+  }
+
+  static uint64_t read_u64(std::istream& in) {
+    u8 bytes[8]{0};
+    in.read((char*)bytes, 8);
+    uint64_t value{0};
+    for (int this_byte{7}; this_byte >= 0; --this_byte) {
+      value = (value << 8) | bytes[this_byte];
+    }
+    return value;
+  }
+
+  static void write_blob(std::ostream& out, std::vector<u8> const& blob) {
+    write_u64(out, blob.size());
+    out.write((char const*)blob.data(), blob.size());
+  }
+
+  static bool read_blob(std::istream& in, std::vector<u8>& blob) {
+    uint64_t const length{read_u64(in)};
+    if (!in.good() || length > ((uint64_t)1 << 32)) {
+      return false;
+    }
+    blob.resize(length);
+    in.read((char*)blob.data(), length);
+    return in.good() || (length == 0 && !in.bad());
+  }
+
+  std::filesystem::path m_dir;
+  uintmax_t m_max_size;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef TILEMAP__CLIENT_H
+#define TILEMAP__CLIENT_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "convert.hpp"
+#include "report.hpp"
+#include "server.hpp"
+
+// connects to a conversion server, returning the socket
+int connect_server(std::string const& socket_path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    throw std::invalid_argument("Socket path too long");
+  }
+  std::strcpy(addr.sun_path, socket_path.c_str());
+
+  int const fd{::socket(AF_UNIX, SOCK_STREAM, 0)};
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  if (::connect(fd, (sockaddr const*)&addr, sizeof(addr)) < 0) {
+    int const error{errno};
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(),
+                            "Could not connect to " + socket_path);
+  }
+  return fd;
+}
+
+// the value below which the given fraction of the (sorted) samples fall
+double percentile(std::vector<double> const& sorted, double fraction) {
+  size_t const rank{(size_t)(fraction * (sorted.size() - 1) + 0.5)};
+  return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+/*
+  Sends an image to a conversion server and writes the .chr, .map (or .chk)
+  and (optionally) .pal files it returns, using output as the base filename
+  With latency_runs above 1, the request is sent that many times over the
+  same connection, bypassing the server's result cache so every request is a
+  full conversion, and the round trip times are reported.
+*/
+int run_client(std::string const& socket_path,
+               std::string const& inpng_filepath, std::string const& output,
+               ConvertOptions const& opts, unsigned int latency_runs) {
+  std::vector<u8> image;
+  if (inpng_filepath.empty()) {
+    image.assign(std::istreambuf_iterator<char>{std::cin},
+                 std::istreambuf_iterator<char>{});
+  } else {
+    std::ifstream in_file{inpng_filepath, std::ios::binary};
+    if (!in_file.good()) {
+      throw std::runtime_error("Could not open " + inpng_filepath);
+    }
+    image.assign(std::istreambuf_iterator<char>{in_file},
+                 std::istreambuf_iterator<char>{});
+  }
+
+  int const fd{connect_server(socket_path)};
+
+  std::vector<u8> request, response_payload;
+  encode_request(request, opts, latency_runs > 1, image);
+
+  ConvertResponse response;
+  std::vector<double> latencies;
+  latencies.reserve(latency_runs);
+  try {
+    for (unsigned int this_run{0}; this_run < std::max(latency_runs, 1u);
+         ++this_run) {
+      auto const start{std::chrono::steady_clock::now()};
+      write_frame(fd, request);
+      if (!read_frame(fd, response_payload)) {
+        throw std::runtime_error("Server closed the connection");
+      }
+      latencies.push_back(std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+      response = decode_response(response_payload);
+      if (!response.Ok) {
+        break;
+      }
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+
+  if (!response.Ok) {
+    std::cerr << "Server error: " << response.Error << std::endl;
+    return -1;
+  }
+
+  TileOptStats stats;
+  write_output(output, *response.Output, opts, nullptr, stats);
+
+  if (response.FromCache) {
+    std::cout << " (from server cache)" << std::endl;
+  }
+  std::cout << " Input tiles:  " << response.Output->InputTiles << std::endl;
+  std::cout << " Output tiles: " << response.Output->OutputTiles << std::endl;
+  if (opts.Compress != Compression::NONE) {
+    print_compression(std::cout, stats);
+  }
+
+  if (latency_runs > 1) {
+    std::vector<double> sorted{latencies};
+    std::sort(sorted.begin(), sorted.end());
+    double total{0};
+    for (auto const this_latency : latencies) {
+      total += this_latency;
+    }
+    std::cout << std::fixed << std::setprecision(3)
+              << " Latency over " << latencies.size() << " requests (ms):"
+              << std::endl
+              << "  first " << latencies.front() << std::endl
+              << "  min   " << sorted.front() << std::endl
+              << "  mean  " << (total / latencies.size()) << std::endl
+              << "  p50   " << percentile(sorted, 0.50) << std::endl
+              << "  p99   " << percentile(sorted, 0.99) << std::endl
+              << "  max   " << sorted.back() << std::endl;
+  }
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef TILEMAP__CONVERT_H
+#define TILEMAP__CONVERT_H
+
+#include <chrgfx/chrgfx.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mdtile/compress.hpp>
+#include <mdtile/md_chrgfx.hpp>
+#include <mdtile/output.hpp>
+#include <mdtile/stats.hpp>
+#include <mdtile/thread_pool.hpp>
+#include <mdtile/tileopt.hpp>
+#include <optional>
+#include <png++/png.hpp>
+#include <stdexcept>
+#include <string>
+
+#include "build_cache.hpp"
+#include "png_stream.hpp"
+#include "tiletypes.hpp"
+
+using namespace chrgfx;
+using namespace mdtile;
+
+// settings that affect the output of a single conversion
+struct ConvertOptions {
+  u16 Base{0};
+  bool MakePalette{false};
+  bool NoMapOptimize{false};
+  // decode the image a strip at a time rather than all at once
+  bool Stream{false};
+  TileOrder Order{TileOrder::SOURCE};
+  // lossy merging of near duplicate tiles: the tile budget and the error
+  // limit (RMS color distance per pixel)
+  std::optional<size_t> MaxTiles{std::nullopt};
+  std::optional<double> MaxError{std::nullopt};
+  // if set, split the map into chunks of this many tiles across and down
+  size_t ChunkWidth{0};
+  size_t ChunkHeight{0};
+  // the image uses all four palette lines (64 colors)
+  bool PaletteLines{false};
+  // check the tilemap with the simulated load_tilemap
+  bool Verify{false};
+  // compression for the tiles and the tilemap, applied as they are written
+  // (so it is not part of the cache key)
+  Compression Compress{Compression::NONE};
+};
+
+// the map is written to a .chk chunk index instead of a .map when chunked
+// (the compression extension is added as the file is written)
+std::string map_file_extension(ConvertOptions const& opts) {
+  return (opts.ChunkWidth > 0 && opts.ChunkHeight > 0) ? ".chk" : ".map";
+}
+
+struct ConvertResult {
+  size_t InputTiles{0};
+  size_t OutputTiles{0};
+  // output was taken from the build cache
+  bool FromCache{false};
+  // only the compress and write phases are timed when the output came from
+  // the cache
+  TileOptStats Stats;
+};
+
+// bump this whenever the output for a given input and options changes, so
+// that stale build cache entries are not used
+std::string const CACHE_KEY_VERSION{"tileopt-4"};
+
+/*
+  Converts one PNG in memory, returning the contents of the .chr, .map and
+  (optionally) .pal files
+  If stats is given, the phase timings and tile counts are added to it
+*/
+ConvertOutput convert_png(std::istream& in_stream, ConvertOptions const& opts,
+                          ThreadPool* pool = nullptr,
+                          TileOptStats* stats = nullptr) {
+  using clock = std::chrono::steady_clock;
+  TileOptStats local_stats;
+  if (!stats) {
+    stats = &local_stats;
+  }
+
+  uint img_width_chr{0};
+  png::palette in_palette;
+  TileOptMap opt_tiles;
+  // tile data the meta points into: either every tile in the image or, when
+  // streaming, copies of just the unique tiles
+  chrbank tile_data;
+  TileStore unique_tiles;
+  // the palette line of each tile (or, when streaming, of each tile in the
+  // strip), with palette lines
+  std::vector<u8> lines;
+
+  if (opts.Stream) {
+    // classify and dedup each strip of tiles as it is decoded, keeping only
+    // the unique tiles and the cells of the map
+    TileOptimizer optimizer{pool, true, stats};
+    auto const decode_start{clock::now()};
+    double const optimize_ms{stats->ClassifyMs + stats->DedupMs};
+    size_t strip_start{0};
+    auto info{stream_png_tiles(in_stream, [&](u8* const* tiles, size_t count) {
+      if (opts.PaletteLines) {
+        lines.clear();
+        split_palette_lines(tiles, count, lines, strip_start);
+      }
+      optimizer.add_tiles(tiles, count,
+                          opts.PaletteLines ? lines.data() : nullptr);
+      strip_start += count;
+    })};
+    // the tile passes run between strips; count only the decoding here
+    add_elapsed(stats->DecodeMs, decode_start);
+    stats->DecodeMs -= stats->ClassifyMs + stats->DedupMs - optimize_ms;
+
+    img_width_chr = info.WidthChr;
+    in_palette = std::move(info.Palette);
+    opt_tiles = optimizer.finish();
+    unique_tiles = optimizer.release_tile_store();
+  } else {
+    {
+      png::image<png::index_pixel> in_image;
+
+      auto phase_start{clock::now()};
+      in_image.read_stream(in_stream);
+      add_elapsed(stats->DecodeMs, phase_start);
+      phase_start = clock::now();
+
+      // width and height of image in tiles
+      img_width_chr = in_image.get_width() / MD_CHR.get_width();
+      uint img_height_chr{in_image.get_height() / MD_CHR.get_height()};
+
+      // convert input png into raw CHR tiles
+      // note that png_chunk returns tiles in STANDARD format
+      // (8bit pixels), not in the chrdef format
+      tile_data = png_chunk(MD_CHR, in_image.get_pixbuf());
+      in_palette = in_image.get_palette();
+      add_elapsed(stats->ChunkMs, phase_start);
+
+      // make sure our tile counts match
+      assert(tile_data.size() == (img_width_chr * img_height_chr));
+    }
+
+    // mark tiles for optimization
+    std::vector<u8*> tile_ptrs;
+    tile_ptrs.reserve(tile_data.size());
+    for (auto const& this_tile : tile_data) {
+      tile_ptrs.push_back(this_tile.get());
+    }
+    if (opts.PaletteLines) {
+      split_palette_lines(tile_ptrs.data(), tile_ptrs.size(), lines);
+    }
+    opt_tiles = optimize_tiles(tile_ptrs, pool, stats);
+    set_palette_lines(opt_tiles, lines);
+  }
+
+  TilesetOptions tileset_opts;
+  tileset_opts.Base = opts.Base;
+  tileset_opts.NoMapOptimize = opts.NoMapOptimize;
+  tileset_opts.Order = opts.Order;
+  tileset_opts.Merge.MaxTiles = opts.MaxTiles;
+  tileset_opts.Merge.MaxError = opts.MaxError;
+  tileset_opts.ChunkWidth = opts.ChunkWidth;
+  tileset_opts.ChunkHeight = opts.ChunkHeight;
+  tileset_opts.PaletteLines = opts.PaletteLines;
+  tileset_opts.Verify = opts.Verify;
+  if (tileset_opts.Merge.enabled()) {
+    // tiles are compared by their colors in the image's palette
+    for (auto const& this_color : in_palette) {
+      tileset_opts.Merge.Palette.push_back(this_color.red);
+      tileset_opts.Merge.Palette.push_back(this_color.green);
+      tileset_opts.Merge.Palette.push_back(this_color.blue);
+    }
+  }
+
+  // final tiles and tilemap
+  Tileset tileset{
+      make_tileset(std::move(opt_tiles), img_width_chr, tileset_opts, pool,
+                   stats)};
+
+  ConvertOutput result;
+  result.InputTiles = tileset.InputTiles;
+  result.OutputTiles = tileset.OutputTiles;
+  result.Chr = std::move(tileset.Chr);
+  result.Map = std::move(tileset.Map);
+
+  // palette, if requested
+  if (opts.MakePalette && opts.PaletteLines) {
+    // all four lines, one after another
+    for (size_t this_line{0}; this_line < PALETTE_LINES; ++this_line) {
+      png::palette line_palette(PALETTE_LINE_COLORS);
+      for (size_t this_color{0}; this_color < PALETTE_LINE_COLORS;
+           ++this_color) {
+        size_t const in_color{(this_line * PALETTE_LINE_COLORS) + this_color};
+        if (in_color < in_palette.size()) {
+          line_palette[this_color] = in_palette[in_color];
+        }
+      }
+      uptr<u8> out_pal{
+          chrgfx::conv_palette::cvto_pal(MD_PAL, MD_COL, line_palette)};
+      result.Pal.insert(result.Pal.end(), out_pal.get(),
+                        out_pal.get() + MD_PAL.get_palette_datasize_bytes());
+    }
+  } else if (opts.MakePalette) {
+    uptr<u8> out_pal{
+        chrgfx::conv_palette::cvto_pal(MD_PAL, MD_COL, in_palette)};
+    result.Pal.assign(out_pal.get(),
+                      out_pal.get() + MD_PAL.get_palette_datasize_bytes());
+  }
+
+  return result;
+}
+
+/*
+  As above, reading the PNG from a file
+  If inpng_filepath is empty, the image is read from stdin
+*/
+ConvertOutput convert_png(std::string const& inpng_filepath,
+                          ConvertOptions const& opts,
+                          ThreadPool* pool = nullptr,
+                          TileOptStats* stats = nullptr) {
+  if (inpng_filepath.empty()) {
+    return convert_png(std::cin, opts, pool, stats);
+  }
+  std::ifstream in_file{inpng_filepath, std::ios::binary};
+  if (!in_file.good()) {
+    throw std::runtime_error("Could not open " + inpng_filepath);
+  }
+  return convert_png(in_file, opts, pool, stats);
+}
+
+/*
+  Writes the .chr, .map (or .chk) and (optionally) .pal files of a
+  conversion, using output as the base filename
+  With compressed output, the tiles and the tilemap are compressed as they
+  are written, at the same time when a pool is given, and their sizes and
+  decode times are added to the stats
+*/
+void write_output(std::string const& output, ConvertOutput const& converted,
+                  ConvertOptions const& opts, ThreadPool* pool,
+                  TileOptStats& stats) {
+  using clock = std::chrono::steady_clock;
+  auto const write_start{clock::now()};
+  if (opts.MakePalette) {
+    write_file(output + ".pal", converted.Pal);
+  }
+  add_elapsed(stats.WriteMs, write_start);
+
+  // the tiles and the tilemap are timed as compression when compressing,
+  // since that is nearly all of the time taken
+  auto const chr_map_start{clock::now()};
+  auto write_chr = [&] {
+    write_compressed_file(output + ".chr", converted.Chr, opts.Compress, pool,
+                          &stats.ChrCompression);
+  };
+  auto write_map = [&] {
+    write_compressed_file(output + map_file_extension(opts), converted.Map,
+                          opts.Compress, pool, &stats.MapCompression);
+  };
+  if (pool && opts.Compress != Compression::NONE) {
+    ThreadPool::TaskGroup group;
+    pool->run(group, write_chr);
+    pool->run(group, write_map);
+    pool->wait(group);
+  } else {
+    write_chr();
+    write_map();
+  }
+  add_elapsed(opts.Compress != Compression::NONE ? stats.CompressMs
+                                                 : stats.WriteMs,
+              chr_map_start);
+}
+
+// starts a cache key with every option that affects the output
+ContentHash cache_key_hash(ConvertOptions const& opts) {
+  ContentHash hash;
+  hash.update_string(CACHE_KEY_VERSION);
+  hash.update_value(opts.Base);
+  hash.update_value(opts.MakePalette);
+  hash.update_value(opts.NoMapOptimize);
+  hash.update_value(opts.Order);
+  hash.update_value(opts.MaxTiles.has_value());
+  hash.update_value(opts.MaxTiles.value_or(0));
+  hash.update_value(opts.MaxError.has_value());
+  hash.update_value(opts.MaxError.value_or(0));
+  hash.update_value(opts.ChunkWidth);
+  hash.update_value(opts.ChunkHeight);
+  hash.update_value(opts.PaletteLines);
+  // verified output is kept apart, so that a cache hit never skips the check
+  hash.update_value(opts.Verify);
+  return hash;
+}
+
+// build cache key for an input file: the file itself (and therefore its
+// pixels and palette) along with every option that affects the output
+std::string cache_key(std::string const& inpng_filepath,
+                      ConvertOptions const& opts) {
+  ContentHash hash{cache_key_hash(opts)};
+
+  std::ifstream in{inpng_filepath, std::ios::binary};
+  if (!in.good()) {
+    throw std::runtime_error("Could not open " + inpng_filepath);
+  }
+  std::vector<char> buffer(1 << 16);
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    hash.update(buffer.data(), in.gcount());
+  }
+  return hash.hex();
+}
+
+/*
+  Converts one PNG into the .chr, .map (or .chk) and (optionally) .pal files,
+  using output as the base filename (see write_output)
+  If a build cache is given and it holds the output for this input and these
+  options, the stored output is used and the image is not decoded at all.
+  If inpng_filepath is empty, the image is read from stdin (and the cache is
+  not used)
+  Timings and tile counts are returned in the result's Stats
+*/
+ConvertResult convert_image(std::string const& inpng_filepath,
+                            std::string const& output,
+                            ConvertOptions const& opts,
+                            ThreadPool* pool = nullptr,
+                            BuildCache const* cache = nullptr) {
+  ConvertResult result;
+  std::optional<ConvertOutput> converted;
+
+  std::string key;
+  if (cache && !inpng_filepath.empty()) {
+    key = cache_key(inpng_filepath, opts);
+    converted = cache->load(key);
+    result.FromCache = converted.has_value();
+  }
+
+  if (!converted) {
+    converted = convert_png(inpng_filepath, opts, pool, &result.Stats);
+    if (!key.empty()) {
+      cache->store(key, converted.value());
+    }
+  }
+
+  write_output(output, converted.value(), opts, pool, result.Stats);
+
+  result.InputTiles = converted->InputTiles;
+  result.OutputTiles = converted->OutputTiles;
+  return result;
+}
+
+#endif
@@ -4,22 +4,32 @@
  (optionally) palette as well as a tilemap suitable for use in the nametable
 */
 #include <getopt.h>
-#include <zlib.h>
 
 #include <chrgfx/chrgfx.hpp>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <mdtile/compress.hpp>
+#include <mdtile/output.hpp>
+#include <mdtile/stats.hpp>
+#include <mdtile/thread_pool.hpp>
 #include <optional>
 #include <png++/png.hpp>
+#include <sstream>
+#include <unordered_map>
 #include <vector>
 
-#include "chr_utils.hpp"
-#include "md_gfx.hpp"
+#include "build_cache.hpp"
+#include "client.hpp"
+#include "convert.hpp"
 #include "project.hpp"
-#include "tileopt.hpp"
-#include "tiletypes.hpp"
+#include "report.hpp"
+#include "server.hpp"
 
 using namespace chrgfx;
+using namespace mdtile;
 
 struct runtime_config {
   string inpng_filepath{""};
@@ -28,9 +38,37 @@ struct runtime_config {
   bool make_palette{false};
   bool no_tile_optimize{false};
   bool no_map_optimize{false};
+  bool stream{false};
+  TileOrder tile_order{TileOrder::SOURCE};
+  std::optional<size_t> max_tiles;
+  std::optional<double> max_error;
+  // split the map into chunks of this many tiles (0 for a single map)
+  size_t chunk_width{0};
+  size_t chunk_height{0};
+  bool palette_lines{false};
+  Compression compress{Compression::NONE};
+  bool verify{false};
+  string cache_dir{""};
+  bool stats{false};
+  string stats_json{""};
+  // in MiB
+  uintmax_t cache_max_size{1024};
+  unsigned int jobs{std::max(std::thread::hardware_concurrency(), 1u)};
+  // batch mode
+  bool batch{false};
+  string batch_list{""};
+  std::vector<string> batch_inputs;
+  // server mode: socket to listen on
+  string serve_socket{""};
+  // client mode: socket of the server to send the image to
+  string connect_socket{""};
+  unsigned int latency_runs{1};
 };
 
 int process_args(runtime_config& cfg, int argc, char** argv);
+ConvertOptions convert_options(runtime_config const& cfg);
+int run_batch(runtime_config const& cfg);
+void write_stats_file(string const& path, string const& body);
 
 int main(int argc, char** argv) {
   try {
@@ -42,7 +80,7 @@ int main(int argc, char** argv) {
         return process_args_result;
       }
 
-      if (cfg.output.empty()) {
+      if (!cfg.batch && cfg.serve_socket.empty() && cfg.output.empty()) {
         if (cfg.inpng_filepath.empty()) {
           std::cerr << "Must specify an output path if using stdin for input"
                     << std::endl;
@@ -55,96 +93,313 @@ int main(int argc, char** argv) {
       return -5;
     }
 
-    std::cout << "Processing " << cfg.inpng_filepath << "..." << std::endl;
+    if (!cfg.serve_socket.empty()) {
+      // in server mode, the cache size limits the in-memory result cache
+      return run_server(cfg.serve_socket, cfg.jobs, cfg.cache_max_size << 20);
+    }
 
-    png::image<png::index_pixel> in_image;
+    if (cfg.batch) {
+      return run_batch(cfg);
+    }
 
-    if (cfg.inpng_filepath.empty()) {
-      in_image.read_stream(std::cin);
-    } else {
-      in_image.read(cfg.inpng_filepath);
+    if (!cfg.connect_socket.empty()) {
+      return run_client(cfg.connect_socket, cfg.inpng_filepath, cfg.output,
+                        convert_options(cfg), cfg.latency_runs);
     }
 
-    // width and height of image in tiles
-    uint img_width_chr{in_image.get_width() / MD_CHR.get_width()},
-        img_height_chr{in_image.get_height() / MD_CHR.get_height()};
+    std::cout << "Processing " << cfg.inpng_filepath << "..." << std::endl;
 
-    // convert input png into raw CHR tiles
-    // note that png_chunk returns tiles in STANDARD format
-    // (8bit pixels), not in the chrdef format
-    chrbank src_tiles{png_chunk(MD_CHR, in_image.get_pixbuf())};
+    ThreadPool pool{cfg.jobs};
+    std::optional<BuildCache> cache;
+    if (!cfg.cache_dir.empty()) {
+      cache.emplace(cfg.cache_dir, cfg.cache_max_size << 20);
+    }
+    auto result{convert_image(cfg.inpng_filepath, cfg.output,
+                              convert_options(cfg), &pool,
+                              cache ? &cache.value() : nullptr)};
 
-    size_t tile_count{src_tiles.size()};
+    if (result.FromCache) {
+      std::cout << " (from cache)" << std::endl;
+    }
 
-    // make sure our tile counts match
-    assert(tile_count == (img_width_chr * img_height_chr));
+    std::cout << " Input tiles:  " << std::to_string(result.InputTiles)
+              << std::endl;
+    std::cout << " Output tiles: " << std::to_string(result.OutputTiles)
+              << std::endl;
+    if (cfg.max_tiles && result.OutputTiles > cfg.max_tiles.value()) {
+      std::cerr << "Warning: could not merge down to " << cfg.max_tiles.value()
+                << " tiles within the error limit" << std::endl;
+    }
 
-    // mark tiles for optimization
-    auto optmeta{optimize_tiles(src_tiles)};
+    if (cfg.stats) {
+      print_stats(std::cout, result.Stats);
+    } else {
+      if (result.Stats.SimMapCycles > 0) {
+        print_verify(std::cout, result.Stats);
+      }
+      if (!result.Stats.StripDmaBytes.empty()) {
+        print_strip_dma(std::cout, result.Stats);
+      }
+      if (result.Stats.MergedTiles > 0) {
+        print_merge(std::cout, result.Stats);
+      }
+      if (cfg.compress != Compression::NONE) {
+        print_compression(std::cout, result.Stats);
+      }
+    }
+
+    if (!cfg.stats_json.empty()) {
+      std::ostringstream json;
+      json << "{\n  \"input\": " << json_string(cfg.inpng_filepath) << ",\n"
+           << "  \"input_tiles\": " << result.InputTiles << ",\n"
+           << "  \"output_tiles\": " << result.OutputTiles << ",\n"
+           << "  \"from_cache\": " << (result.FromCache ? "true" : "false")
+           << ",\n";
+      write_stats_json(json, result.Stats, "  ");
+      json << ",\n  \"peak_rss_kib\": " << peak_rss_kib() << "\n}\n";
+      write_stats_file(cfg.stats_json, json.str());
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "Fatal Error: " << e.what() << std::endl;
+    return -1;
+  }
 
-    // filter and re-order tiles
-    auto final_tiles{make_tile_list(optmeta)};
+  return 0;
+}
 
-    // write tile data to file
-    std::ofstream tile_data_file(std::string(cfg.output + ".chr"));
-    for (auto this_tile : final_tiles) {
-      tile_data_file.write((char*)chrgfx::conv_chr::cvto_chr(MD_CHR, this_tile),
-                           32);
+/*
+  Batch mode
+  Converts many images in one process: each image is a job on the work
+  stealing pool, so decoding, optimizing and writing overlap across images,
+  and idle threads help out with the tile passes of larger images.
+  The output option, if given, is the directory for the output files. Each
+  job uses the filename of its input as the base name.
+*/
+int run_batch(runtime_config const& cfg) {
+  std::vector<string> inputs{cfg.batch_inputs};
+
+  if (!cfg.batch_list.empty()) {
+    std::ifstream list_file{cfg.batch_list};
+    if (!list_file.good()) {
+      throw std::invalid_argument("Could not open batch list " +
+                                  cfg.batch_list);
     }
-    tile_data_file.close();
+    string this_line;
+    while (std::getline(list_file, this_line)) {
+      // skip blank lines and comments
+      if (this_line.empty() || this_line[0] == '#') {
+        continue;
+      }
+      inputs.push_back(this_line);
+    }
+  }
 
-    // dump palette if requested
-    if (cfg.make_palette) {
-      uptr<u8> out_pal{chrgfx::conv_palette::cvto_pal(MD_PAL, MD_COL,
-                                                      in_image.get_palette())};
-      std::ofstream tile_palette_file(std::string(cfg.output + ".pal"));
-      tile_palette_file.write((char*)out_pal.get(),
-                              MD_PAL.get_palette_datasize_bytes());
-      tile_palette_file.close();
+  if (inputs.empty()) {
+    std::cerr << "No input images for batch" << std::endl;
+    return -1;
+  }
+
+  struct batch_job {
+    string input;
+    string output;
+    ConvertResult result;
+    string error;
+    double millis{0};
+  };
+
+  std::vector<batch_job> jobs;
+  jobs.reserve(inputs.size());
+  std::unordered_map<string, string> output_names;
+  for (auto const& this_input : inputs) {
+    batch_job this_job;
+    this_job.input = this_input;
+    std::filesystem::path out_path{
+        std::filesystem::path(this_input).filename()};
+    if (!cfg.output.empty()) {
+      out_path = std::filesystem::path(cfg.output) / out_path;
+    }
+    this_job.output = out_path;
+
+    // two inputs with the same filename would overwrite each other's output
+    auto existing{output_names.emplace(this_job.output, this_input)};
+    if (!existing.second) {
+      std::cerr << "Inputs " << existing.first->second << " and " << this_input
+                << " would both write to " << this_job.output << std::endl;
+      return -1;
     }
+    jobs.push_back(this_job);
+  }
 
-    // genetate optimized tilemap list
-    auto final_tilemap{
-        make_tilemap_list(optimize_tilemap(optmeta, cfg.no_map_optimize),
-                          cfg.base, img_width_chr)};
+  if (!cfg.output.empty()) {
+    std::filesystem::create_directories(cfg.output);
+  }
 
-    std::ofstream tile_map_file(std::string(cfg.output + ".map"));
+  ConvertOptions const opts{convert_options(cfg)};
 
-    u8* (*copyfunc)(u8*, u8*, u8*);
-    if (chrgfx::bigend_sys) {
-      copyfunc = std::copy;
-    } else {
-      copyfunc = std::reverse_copy;
+  std::cout << "Processing " << jobs.size() << " images..." << std::endl;
+  auto const batch_start{std::chrono::steady_clock::now()};
+
+  ThreadPool pool{cfg.jobs};
+  std::optional<BuildCache> cache;
+  if (!cfg.cache_dir.empty()) {
+    cache.emplace(cfg.cache_dir, cfg.cache_max_size << 20);
+  }
+  BuildCache const* cache_ptr{cache ? &cache.value() : nullptr};
+
+  ThreadPool::TaskGroup batch_group;
+  for (auto& this_job : jobs) {
+    pool.run(batch_group, [&this_job, &opts, &pool, cache_ptr] {
+      auto const job_start{std::chrono::steady_clock::now()};
+      try {
+        this_job.result = convert_image(this_job.input, this_job.output, opts,
+                                        &pool, cache_ptr);
+      } catch (std::exception const& e) {
+        this_job.error = e.what();
+      }
+      this_job.millis = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - job_start)
+                            .count();
+    });
+  }
+  pool.wait(batch_group);
+
+  double const batch_millis{std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - batch_start)
+                                .count()};
+
+  // summary
+  size_t failed{0}, cached{0}, total_in{0}, total_out{0};
+  TileOptStats total_stats;
+  for (auto const& this_job : jobs) {
+    std::cout << " " << this_job.input << ": ";
+    if (!this_job.error.empty()) {
+      std::cout << "FAILED (" << this_job.error << ")" << std::endl;
+      ++failed;
+      continue;
+    }
+    std::cout << this_job.result.InputTiles << " -> "
+              << this_job.result.OutputTiles << " tiles, " << std::fixed
+              << std::setprecision(1) << this_job.millis << " ms"
+              << (this_job.result.FromCache ? " (cached)" : "") << std::endl;
+    if (this_job.result.FromCache) {
+      ++cached;
+    }
+    total_in += this_job.result.InputTiles;
+    total_out += this_job.result.OutputTiles;
+    add_stats(total_stats, this_job.result.Stats);
+  }
+
+  std::cout << "Images:       " << (jobs.size() - failed) << " converted, "
+            << failed << " failed";
+  if (cache_ptr) {
+    std::cout << ", " << cached << " from cache";
+  }
+  std::cout << std::endl;
+  std::cout << "Input tiles:  " << total_in << std::endl;
+  std::cout << "Output tiles: " << total_out << std::endl;
+  std::cout << "Total time:   " << std::fixed << std::setprecision(1)
+            << batch_millis << " ms (" << pool.size() << " threads)"
+            << std::endl;
+
+  // phase times are summed across jobs, so they can exceed the total time
+  if (cfg.stats) {
+    print_stats(std::cout, total_stats);
+  } else {
+    if (total_stats.SimMapCycles > 0) {
+      print_verify(std::cout, total_stats);
+    }
+    if (!total_stats.StripDmaBytes.empty()) {
+      print_strip_dma(std::cout, total_stats);
+    }
+    if (total_stats.MergedTiles > 0) {
+      print_merge(std::cout, total_stats);
     }
-    size_t out_iter{0};
-    u8 temp[2];
-    for (auto this_raw_entry : final_tilemap) {
-      copyfunc((u8*)&this_raw_entry, (u8*)&this_raw_entry + 2, temp);
+    if (cfg.compress != Compression::NONE) {
+      print_compression(std::cout, total_stats);
+    }
+  }
 
-      tile_map_file.write((char const*)temp, 2);
-      ++out_iter;
+  if (!cfg.stats_json.empty()) {
+    std::ostringstream json;
+    json << "{\n  \"jobs\": [";
+    bool first{true};
+    for (auto const& this_job : jobs) {
+      json << (first ? "\n" : ",\n") << "    {\n"
+           << "      \"input\": " << json_string(this_job.input) << ",\n";
+      first = false;
+      if (!this_job.error.empty()) {
+        json << "      \"error\": " << json_string(this_job.error) << "\n    }";
+        continue;
+      }
+      json << "      \"input_tiles\": " << this_job.result.InputTiles << ",\n"
+           << "      \"output_tiles\": " << this_job.result.OutputTiles
+           << ",\n"
+           << "      \"from_cache\": "
+           << (this_job.result.FromCache ? "true" : "false") << ",\n"
+           << "      \"total_ms\": " << this_job.millis << ",\n";
+      write_stats_json(json, this_job.result.Stats, "      ");
+      json << "\n    }";
     }
-    tile_map_file.close();
+    json << "\n  ],\n  \"totals\": {\n"
+         << "    \"converted\": " << (jobs.size() - failed) << ",\n"
+         << "    \"failed\": " << failed << ",\n"
+         << "    \"from_cache\": " << cached << ",\n"
+         << "    \"input_tiles\": " << total_in << ",\n"
+         << "    \"output_tiles\": " << total_out << ",\n"
+         << "    \"total_ms\": " << batch_millis << ",\n"
+         << "    \"threads\": " << pool.size() << ",\n";
+    write_stats_json(json, total_stats, "    ");
+    json << "\n  },\n  \"peak_rss_kib\": " << peak_rss_kib() << "\n}\n";
+    write_stats_file(cfg.stats_json, json.str());
+  }
 
-    std::cout << " Input tiles:  " << std::to_string(tile_count) << std::endl;
-    std::cout << " Output tiles: " << std::to_string(final_tiles.size())
-              << std::endl;
+  return failed == 0 ? 0 : -1;
+}
 
-  } catch (std::exception const& e) {
-    std::cerr << "Fatal Error: " << e.what() << std::endl;
-    return -1;
+// writes the stats JSON to a file, or to stdout if the path is -
+void write_stats_file(string const& path, string const& body) {
+  if (path == "-") {
+    std::cout << body;
+    return;
   }
+  write_file(path, (u8 const*)body.data(), body.size());
+}
 
-  return 0;
+// the settings that affect the output of each conversion
+ConvertOptions convert_options(runtime_config const& cfg) {
+  return ConvertOptions{cfg.base, cfg.make_palette, cfg.no_map_optimize,
+                        cfg.stream, cfg.tile_order, cfg.max_tiles,
+                        cfg.max_error, cfg.chunk_width, cfg.chunk_height,
+                        cfg.palette_lines, cfg.verify, cfg.compress};
 }
 
 int process_args(runtime_config& cfg, int argc, char** argv) {
-  string short_opts{":i:o:b:phTM"};
+  string short_opts{":i:o:b:j:l:c:C:J:D:N:R:t:X:E:k:z:phTMBSsLV"};
   std::vector<option> long_opts{{"image", required_argument, nullptr, 'i'},
                                 {"output", required_argument, nullptr, 'o'},
                                 {"base", required_argument, nullptr, 'b'},
                                 {"make-palette", no_argument, nullptr, 'p'},
                                 {"no-map-optimize", no_argument, nullptr, 'M'},
+                                {"tile-order", required_argument, nullptr, 't'},
+                                {"max-tiles", required_argument, nullptr, 'X'},
+                                {"max-error", required_argument, nullptr, 'E'},
+                                {"chunk", required_argument, nullptr, 'k'},
+                                {"palette-lines", no_argument, nullptr, 'L'},
+                                {"compress", required_argument, nullptr, 'z'},
+                                {"verify", no_argument, nullptr, 'V'},
+                                {"jobs", required_argument, nullptr, 'j'},
+                                {"batch", no_argument, nullptr, 'B'},
+                                {"stream", no_argument, nullptr, 'S'},
+                                {"cache-dir", required_argument, nullptr, 'c'},
+                                {"cache-max-size", required_argument, nullptr,
+                                 'C'},
+                                {"list", required_argument, nullptr, 'l'},
+                                {"stats", no_argument, nullptr, 's'},
+                                {"serve", required_argument, nullptr, 'D'},
+                                {"connect", required_argument, nullptr, 'N'},
+                                {"latency-runs", required_argument, nullptr,
+                                 'R'},
+                                {"stats-json", required_argument, nullptr, 'J'},
                                 {"help", no_argument, nullptr, 'h'}};
 
   while (true) {
@@ -173,6 +428,132 @@ int process_args(runtime_config& cfg, int argc, char** argv) {
         cfg.no_map_optimize = true;
         break;
 
+      case 't': {
+        string order{optarg};
+        if (order == "source") {
+          cfg.tile_order = TileOrder::SOURCE;
+        } else if (order == "row") {
+          cfg.tile_order = TileOrder::ROW;
+        } else if (order == "column") {
+          cfg.tile_order = TileOrder::COLUMN;
+        } else {
+          throw std::invalid_argument(
+              "Tile order must be source, row or column");
+        }
+        break;
+      }
+
+      case 'X': {
+        int max_tiles{std::stoi(optarg)};
+        if (max_tiles < 1) {
+          throw std::invalid_argument("Max tiles must be at least 1");
+        }
+        cfg.max_tiles = max_tiles;
+        break;
+      }
+
+      case 'E': {
+        double max_error{std::stod(optarg)};
+        if (max_error < 0) {
+          throw std::invalid_argument("Max error cannot be negative");
+        }
+        cfg.max_error = max_error;
+        break;
+      }
+
+      case 'k': {
+        // chunk size as WxH, in tiles
+        string size{optarg};
+        size_t const split{size.find('x')};
+        if (split == string::npos) {
+          throw std::invalid_argument("Chunk size must be WxH");
+        }
+        int const width{std::stoi(size.substr(0, split))};
+        int const height{std::stoi(size.substr(split + 1))};
+        if (width < 1 || height < 1 ||
+            (size_t)width * (size_t)height > MAX_CHUNK_TILES) {
+          throw std::invalid_argument(
+              "Chunk size must be at least 1x1 and at most " +
+              std::to_string(MAX_CHUNK_TILES) + " tiles");
+        }
+        cfg.chunk_width = width;
+        cfg.chunk_height = height;
+        break;
+      }
+
+      case 'L':
+        cfg.palette_lines = true;
+        break;
+
+      case 'V':
+        cfg.verify = true;
+        break;
+
+      case 'z': {
+        auto const method{find_compression(optarg)};
+        if (!method) {
+          throw std::invalid_argument(
+              "Compression must be none, kosinski or kosm");
+        }
+        cfg.compress = method.value();
+        break;
+      }
+
+      case 'B':
+        cfg.batch = true;
+        break;
+
+      case 'S':
+        cfg.stream = true;
+        break;
+
+      case 'c':
+        cfg.cache_dir = optarg;
+        break;
+
+      case 'C':
+        cfg.cache_max_size = std::stoul(optarg);
+        break;
+
+      case 's':
+        cfg.stats = true;
+        break;
+
+      case 'J':
+        cfg.stats_json = optarg;
+        break;
+
+      case 'D':
+        cfg.serve_socket = optarg;
+        break;
+
+      case 'N':
+        cfg.connect_socket = optarg;
+        break;
+
+      case 'R': {
+        int runs{std::stoi(optarg)};
+        if (runs < 1) {
+          throw std::invalid_argument("Latency runs must be at least 1");
+        }
+        cfg.latency_runs = runs;
+        break;
+      }
+
+      case 'l':
+        cfg.batch = true;
+        cfg.batch_list = optarg;
+        break;
+
+      case 'j': {
+        int jobs{std::stoi(optarg)};
+        if (jobs < 1) {
+          throw std::invalid_argument("Job count must be at least 1");
+        }
+        cfg.jobs = jobs;
+        break;
+      }
+
         // help
       case 'h':
         print_help();
@@ -189,5 +570,15 @@ int process_args(runtime_config& cfg, int argc, char** argv) {
     }
   }
 
+  // in batch mode, any remaining arguments are input images
+  if (cfg.batch) {
+    for (int this_arg{optind}; this_arg < argc; ++this_arg) {
+      cfg.batch_inputs.push_back(argv[this_arg]);
+    }
+    if (!cfg.inpng_filepath.empty()) {
+      cfg.batch_inputs.push_back(cfg.inpng_filepath);
+    }
+  }
+
   return 1;
 }
@@ -0,0 +1,88 @@
+#ifndef TILEMAP__PNG_STREAM_H
+#define TILEMAP__PNG_STREAM_H
+
+#include <chrgfx/chrgfx.hpp>
+#include <functional>
+#include <istream>
+#include <mdtile/types.hpp>
+#include <png++/png.hpp>
+#include <stdexcept>
+#include <vector>
+
+using namespace chrgfx;
+using namespace mdtile;
+
+struct PngStreamInfo {
+  // dimensions of the image in tiles
+  uint WidthChr{0};
+  uint HeightChr{0};
+  png::palette Palette;
+};
+
+/*
+  Reads an indexed PNG one strip of tiles (CHR_HEIGHT scanlines) at a time
+  Each strip is cut into tiles in standard (8bit) format and passed to
+  on_strip, left to right; the tiles are only valid until on_strip returns,
+  as the buffers are reused for the next strip. Only one strip of the image
+  is ever held in memory.
+  As with png_chunk, any partial tiles at the right or bottom edge are
+  dropped.
+*/
+PngStreamInfo stream_png_tiles(
+    std::istream& in,
+    std::function<void(u8* const* tiles, size_t count)> const& on_strip) {
+  png::reader<std::istream> png_reader{in};
+  png_reader.read_info();
+
+  if (png_reader.get_color_type() != png::color_type_palette) {
+    throw std::runtime_error("Input image must be indexed color");
+  }
+  if (png_reader.get_interlace_type() != png::interlace_none) {
+    // rows from an interlaced image arrive in passes over the whole image
+    throw std::runtime_error("Interlaced images cannot be streamed");
+  }
+  // unpack 1/2/4 bit images to one byte per pixel
+  if (png_reader.get_bit_depth() < 8) {
+    png_reader.set_packing();
+  }
+  png_reader.update_info();
+
+  PngStreamInfo info;
+  info.WidthChr = png_reader.get_width() / CHR_WIDTH;
+  info.HeightChr = png_reader.get_height() / CHR_HEIGHT;
+  info.Palette = png_reader.get_palette();
+
+  size_t const row_bytesize{png_reader.get_width()};
+  std::vector<u8> strip_rows(row_bytesize * CHR_HEIGHT);
+  std::vector<u8> strip_tiles((size_t)info.WidthChr * CHR_BYTESIZE);
+  std::vector<u8*> strip_tile_ptrs(info.WidthChr);
+  for (uint this_tile{0}; this_tile < info.WidthChr; ++this_tile) {
+    strip_tile_ptrs[this_tile] =
+        strip_tiles.data() + ((size_t)this_tile * CHR_BYTESIZE);
+  }
+
+  for (uint this_strip{0}; this_strip < info.HeightChr; ++this_strip) {
+    for (uint this_row{0}; this_row < CHR_HEIGHT; ++this_row) {
+      png_reader.read_row(strip_rows.data() + (this_row * row_bytesize));
+    }
+
+    // cut the strip into tiles
+    for (uint this_tile{0}; this_tile < info.WidthChr; ++this_tile) {
+      u8* tile_out{strip_tile_ptrs[this_tile]};
+      for (uint this_row{0}; this_row < CHR_HEIGHT; ++this_row) {
+        u8 const* row_in{strip_rows.data() + (this_row * row_bytesize) +
+                         (this_tile * CHR_WIDTH)};
+        std::copy(row_in, row_in + CHR_WIDTH, tile_out);
+        tile_out += CHR_WIDTH;
+      }
+    }
+
+    on_strip(strip_tile_ptrs.data(), strip_tile_ptrs.size());
+  }
+
+  // any scanlines below the last full strip are left unread, which is fine
+  // since we are done with the stream
+  return info;
+}
+
+#endif
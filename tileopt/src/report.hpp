@@ -0,0 +1,203 @@
+#ifndef TILEMAP__REPORT_H
+#define TILEMAP__REPORT_H
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <mdtile/merge.hpp>
+#include <mdtile/stats.hpp>
+#include <ostream>
+#include <string>
+
+using namespace mdtile;
+
+// peak resident set size of the process so far, in KiB
+long peak_rss_kib() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_maxrss;
+}
+
+// reports the cycles the simulated load_tilemap and clear_tilemap took to
+// draw and clear the verified tilemap
+void print_verify(std::ostream& out, TileOptStats const& stats) {
+  out << " Tilemap verified: " << stats.SimMapCycles
+      << " cycles to load, " << stats.SimClearCycles << " cycles to clear"
+      << std::endl;
+}
+
+// reports the tiles removed by merging and the error that introduced
+void print_merge(std::ostream& out, TileOptStats const& stats) {
+  out << " Merged tiles: " << stats.MergedTiles << ", replacing "
+      << stats.MergeChangedTiles << " map tiles" << std::endl
+      << std::fixed << std::setprecision(2) << "  RMS color error: "
+      << rms_color_error(stats.MergeErrorSum, stats.MergeChangedTiles)
+      << " over replaced tiles, "
+      << rms_color_error(stats.MergeMaxError, 1) << " worst tile" << std::endl;
+}
+
+// reports the size and decode time of the compressed tiles and tilemap
+void print_compression(std::ostream& out, TileOptStats const& stats) {
+  auto print_file = [&out](char const* name, CompressionStats const& file) {
+    out << "  " << name << describe_compression(file) << std::endl;
+  };
+  out << " Compression:" << std::endl;
+  print_file("tiles ", stats.ChrCompression);
+  print_file("map   ", stats.MapCompression);
+}
+
+// summarizes the new tile data each strip of the map needs
+void print_strip_dma(std::ostream& out, TileOptStats const& stats) {
+  size_t total{0}, max{0};
+  for (auto const this_strip : stats.StripDmaBytes) {
+    total += this_strip;
+    max = std::max(max, this_strip);
+  }
+  out << " Strip DMA: " << stats.StripDmaBytes.size() << " strips, max "
+      << max << " bytes, mean " << std::fixed << std::setprecision(1)
+      << ((double)total / stats.StripDmaBytes.size()) << " bytes" << std::endl;
+}
+
+void print_stats(std::ostream& out, TileOptStats const& stats) {
+  out << std::fixed << std::setprecision(2);
+  out << " Timing (ms):" << std::endl
+      << "  decode      " << stats.DecodeMs << std::endl
+      << "  chunk       " << stats.ChunkMs << std::endl
+      << "  classify    " << stats.ClassifyMs << std::endl
+      << "  dedup       " << stats.DedupMs << std::endl
+      << "  reorder     " << stats.ReorderMs << std::endl
+      << "  merge       " << stats.MergeMs << std::endl
+      << "  map encode  " << stats.MapEncodeMs << std::endl
+      << "  compress    " << stats.CompressMs << std::endl
+      << "  write       " << stats.WriteMs << std::endl;
+  out << " Tiles:" << std::endl
+      << "  blank       " << stats.BlankTiles << std::endl
+      << "  flat        " << stats.FlatTiles << " (" << stats.FlatDupes
+      << " dupes)" << std::endl
+      << "  normal      " << stats.NormalTiles << std::endl
+      << "  exact dupes " << stats.ExactDupes << std::endl
+      << "  hflip dupes " << stats.HFlipDupes << std::endl
+      << "  vflip dupes " << stats.VFlipDupes << std::endl
+      << "  hvflip dupes " << stats.HVFlipDupes << std::endl
+      << "  unique      " << stats.UniqueTiles << std::endl;
+  out << " Tilemap runs (length: entries):" << std::endl << "  tile ";
+  for (auto const& this_run : stats.TileRuns) {
+    out << " " << this_run.first << ":" << this_run.second;
+  }
+  out << std::endl << "  blank";
+  for (auto const& this_run : stats.BlankRuns) {
+    out << " " << this_run.first << ":" << this_run.second;
+  }
+  out << std::endl;
+  out << " Tilemap: " << stats.MapWords << " words, ~" << stats.MapCycles
+      << " cycles to load" << std::endl;
+  if (stats.SimMapCycles > 0) {
+    print_verify(out, stats);
+  }
+  if (stats.MergedTiles > 0) {
+    print_merge(out, stats);
+  }
+  if (stats.ChrCompression.Bytes + stats.MapCompression.Bytes > 0) {
+    print_compression(out, stats);
+  }
+  if (!stats.StripDmaBytes.empty()) {
+    print_strip_dma(out, stats);
+    out << "  bytes per strip";
+    for (auto const this_strip : stats.StripDmaBytes) {
+      out << " " << this_strip;
+    }
+    out << std::endl;
+  }
+  out << " Peak RSS: " << peak_rss_kib() << " KiB" << std::endl;
+}
+
+// writes the stats as the members of a JSON object (without the braces)
+void write_stats_json(std::ostream& out, TileOptStats const& stats,
+                      std::string const& indent) {
+  auto write_runs = [&out](std::map<size_t, size_t> const& runs) {
+    out << "{";
+    bool first{true};
+    for (auto const& this_run : runs) {
+      out << (first ? "" : ", ") << "\"" << this_run.first
+          << "\": " << this_run.second;
+      first = false;
+    }
+    out << "}";
+  };
+
+  out << std::fixed << std::setprecision(3);
+  out << indent << "\"phases_ms\": {\"decode\": " << stats.DecodeMs
+      << ", \"chunk\": " << stats.ChunkMs
+      << ", \"classify\": " << stats.ClassifyMs
+      << ", \"dedup\": " << stats.DedupMs
+      << ", \"reorder\": " << stats.ReorderMs
+      << ", \"merge\": " << stats.MergeMs
+      << ", \"map_encode\": " << stats.MapEncodeMs
+      << ", \"compress\": " << stats.CompressMs
+      << ", \"write\": " << stats.WriteMs << "},\n";
+  out << indent << "\"tiles\": {\"blank\": " << stats.BlankTiles
+      << ", \"flat\": " << stats.FlatTiles
+      << ", \"normal\": " << stats.NormalTiles
+      << ", \"unique\": " << stats.UniqueTiles << "},\n";
+  out << indent << "\"dupes\": {\"flat\": " << stats.FlatDupes
+      << ", \"exact\": " << stats.ExactDupes
+      << ", \"hflip\": " << stats.HFlipDupes
+      << ", \"vflip\": " << stats.VFlipDupes
+      << ", \"hvflip\": " << stats.HVFlipDupes << "},\n";
+  out << indent << "\"map_runs\": {\"tile\": ";
+  write_runs(stats.TileRuns);
+  out << ", \"blank\": ";
+  write_runs(stats.BlankRuns);
+  out << "},\n";
+  out << indent << "\"map\": {\"words\": " << stats.MapWords
+      << ", \"cycles\": " << stats.MapCycles
+      << ", \"sim_cycles\": " << stats.SimMapCycles
+      << ", \"sim_clear_cycles\": " << stats.SimClearCycles << "},\n";
+  out << indent << "\"merge\": {\"merged_tiles\": " << stats.MergedTiles
+      << ", \"changed_map_tiles\": " << stats.MergeChangedTiles
+      << ", \"rms_error\": "
+      << rms_color_error(stats.MergeErrorSum, stats.MergeChangedTiles)
+      << ", \"max_rms_error\": " << rms_color_error(stats.MergeMaxError, 1)
+      << "},\n";
+  auto write_compression = [&out](CompressionStats const& file) {
+    out << "{\"bytes\": " << file.Bytes
+        << ", \"compressed_bytes\": " << file.CompressedBytes
+        << ", \"decode_cycles\": " << file.DecodeCycles << "}";
+  };
+  out << indent << "\"compression\": {\"chr\": ";
+  write_compression(stats.ChrCompression);
+  out << ", \"map\": ";
+  write_compression(stats.MapCompression);
+  out << "},\n";
+  out << indent << "\"strip_dma_bytes\": [";
+  for (size_t this_strip{0}; this_strip < stats.StripDmaBytes.size();
+       ++this_strip) {
+    out << (this_strip > 0 ? ", " : "") << stats.StripDmaBytes[this_strip];
+  }
+  out << "]";
+}
+
+// escapes a string for use in JSON, with control characters as \u00XX
+std::string json_string(std::string const& value) {
+  static char const hex_digits[]{"0123456789abcdef"};
+  std::string out{"\""};
+  for (char const this_char : value) {
+    if ((u8)this_char < 0x20) {
+      out += "\\u00";
+      out += hex_digits[(u8)this_char >> 4];
+      out += hex_digits[(u8)this_char & 0xf];
+      continue;
+    }
+    if (this_char == '"' || this_char == '\\') {
+      out += '\\';
+    }
+    out += this_char;
+  }
+  return out + "\"";
+}
+
+#endif
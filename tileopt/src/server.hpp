@@ -0,0 +1,536 @@
+#ifndef TILEMAP__SERVER_H
+#define TILEMAP__SERVER_H
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mdtile/thread_pool.hpp>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "build_cache.hpp"
+#include "convert.hpp"
+#include "tiletypes.hpp"
+
+using namespace mdtile;
+
+/*
+  Conversion server protocol
+  Messages travel over a Unix domain stream socket as frames: a 32 bit little
+  endian payload length followed by the payload. A connection may carry any
+  number of requests, each answered by one response, in order.
+
+  Request payload:
+    8 bytes  magic "TOPTREQ6"
+    2 bytes  tile base (little endian)
+    1 byte   flags: 0x01 make palette, 0x02 no map optimize, 0x04 stream,
+             0x08 skip the result cache, 0x40 first use tile order by row,
+             0x80 first use tile order by column
+    1 byte   more flags: 0x01 merge tile budget set, 0x02 merge error limit
+             set, 0x04 palette lines, 0x08 verify the tilemap
+    4 bytes  tile budget for merging (little endian)
+    4 bytes  error limit for merging, in thousandths (little endian)
+    2 bytes  chunk width in tiles, 0 for a single map (little endian)
+    2 bytes  chunk height in tiles (little endian)
+    ...      the PNG file
+
+  Response payload:
+    8 bytes  magic "TOPTRES1"
+    1 byte   status: 0 success, 1 error
+    1 byte   flags: 0x01 result came from the cache
+    2 bytes  reserved (0)
+  followed, on success, by
+    8 bytes  input tile count
+    8 bytes  output tile count
+    for each of the .chr, .map (or .chk) and .pal contents: 4 byte length,
+    then data
+  or, on error, by
+    4 byte length, then the error message
+*/
+
+// largest frame we will accept, to guard against garbage on the socket
+size_t const MAX_FRAME_SIZE{(size_t)256 << 20};
+
+u8 const REQUEST_MAKE_PALETTE{0x01};
+u8 const REQUEST_NO_MAP_OPTIMIZE{0x02};
+u8 const REQUEST_STREAM{0x04};
+u8 const REQUEST_SKIP_CACHE{0x08};
+u8 const REQUEST_ORDER_ROW{0x40};
+u8 const REQUEST_ORDER_COLUMN{0x80};
+
+u8 const REQUEST_MAX_TILES{0x01};
+u8 const REQUEST_MAX_ERROR{0x02};
+u8 const REQUEST_PALETTE_LINES{0x04};
+u8 const REQUEST_VERIFY{0x08};
+
+u8 const RESPONSE_FROM_CACHE{0x01};
+
+char const REQUEST_MAGIC[8]{'T', 'O', 'P', 'T', 'R', 'E', 'Q', '6'};
+char const RESPONSE_MAGIC[8]{'T', 'O', 'P', 'T', 'R', 'E', 'S', '1'};
+
+size_t const REQUEST_HEADER_SIZE{24};
+
+struct ConvertResponse {
+  bool Ok{false};
+  bool FromCache{false};
+  std::string Error;
+  // shared with the result cache, so cached results are sent without a copy
+  std::shared_ptr<ConvertOutput const> Output;
+};
+
+/*
+  Socket I/O
+*/
+void write_all(int fd, void const* data, size_t length) {
+  u8 const* bytes{(u8 const*)data};
+  while (length > 0) {
+    ssize_t const written{::send(fd, bytes, length, MSG_NOSIGNAL)};
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "send");
+    }
+    bytes += written;
+    length -= written;
+  }
+}
+
+// returns false if the connection was closed before any data was read
+bool read_all(int fd, void* data, size_t length) {
+  u8* bytes{(u8*)data};
+  size_t remaining{length};
+  while (remaining > 0) {
+    ssize_t const got{::recv(fd, bytes, remaining, 0)};
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "recv");
+    }
+    if (got == 0) {
+      if (remaining == length) {
+        return false;
+      }
+      throw std::runtime_error("Connection closed mid-message");
+    }
+    bytes += got;
+    remaining -= got;
+  }
+  return true;
+}
+
+void write_frame(int fd, std::vector<u8> const& payload) {
+  u8 header[4];
+  for (int this_byte{0}; this_byte < 4; ++this_byte) {
+    header[this_byte] = (u8)(payload.size() >> (this_byte * 8));
+  }
+  write_all(fd, header, sizeof(header));
+  write_all(fd, payload.data(), payload.size());
+}
+
+// reads a frame into payload, reusing its storage
+// returns false if the peer closed the connection between frames
+bool read_frame(int fd, std::vector<u8>& payload) {
+  u8 header[4];
+  if (!read_all(fd, header, sizeof(header))) {
+    return false;
+  }
+  size_t length{0};
+  for (int this_byte{3}; this_byte >= 0; --this_byte) {
+    length = (length << 8) | header[this_byte];
+  }
+  if (length > MAX_FRAME_SIZE) {
+    throw std::runtime_error("Frame too large");
+  }
+  payload.resize(length);
+  if (length > 0 && !read_all(fd, payload.data(), length)) {
+    throw std::runtime_error("Connection closed mid-message");
+  }
+  return true;
+}
+
+/*
+  Message encoding
+*/
+void put_u32(std::vector<u8>& out, u32 value) {
+  for (int this_byte{0}; this_byte < 4; ++this_byte) {
+    out.push_back((u8)(value >> (this_byte * 8)));
+  }
+}
+
+void put_u64(std::vector<u8>& out, uint64_t value) {
+  for (int this_byte{0}; this_byte < 8; ++this_byte) {
+    out.push_back((u8)(value >> (this_byte * 8)));
+  }
+}
+
+void put_blob(std::vector<u8>& out, std::vector<u8> const& blob) {
+  put_u32(out, blob.size());
+  out.insert(out.end(), blob.begin(), blob.end());
+}
+
+// reads little endian values and blobs from a payload, with bounds checks
+class PayloadReader {
+ public:
+  PayloadReader(std::vector<u8> const& payload, size_t offset)
+      : m_payload{payload}, m_offset{offset} {}
+
+  uint64_t get(size_t bytes) {
+    need(bytes);
+    uint64_t value{0};
+    for (size_t this_byte{bytes}; this_byte > 0; --this_byte) {
+      value = (value << 8) | m_payload[m_offset + this_byte - 1];
+    }
+    m_offset += bytes;
+    return value;
+  }
+
+  void get_blob(std::vector<u8>& blob) {
+    size_t const length{(size_t)get(4)};
+    need(length);
+    blob.assign(m_payload.begin() + m_offset,
+                m_payload.begin() + m_offset + length);
+    m_offset += length;
+  }
+
+ private:
+  void need(size_t bytes) const {
+    if (m_payload.size() - m_offset < bytes) {
+      throw std::runtime_error("Truncated message");
+    }
+  }
+
+  std::vector<u8> const& m_payload;
+  size_t m_offset;
+};
+
+// builds a request payload; the image is appended as-is
+void encode_request(std::vector<u8>& out, ConvertOptions const& opts,
+                    bool skip_cache, std::vector<u8> const& image) {
+  out.clear();
+  out.reserve(REQUEST_HEADER_SIZE + image.size());
+  out.insert(out.end(), REQUEST_MAGIC, REQUEST_MAGIC + sizeof(REQUEST_MAGIC));
+  out.push_back((u8)opts.Base);
+  out.push_back((u8)(opts.Base >> 8));
+  out.push_back((opts.MakePalette ? REQUEST_MAKE_PALETTE : 0) |
+                (opts.NoMapOptimize ? REQUEST_NO_MAP_OPTIMIZE : 0) |
+                (opts.Stream ? REQUEST_STREAM : 0) |
+                (skip_cache ? REQUEST_SKIP_CACHE : 0) |
+                (opts.Order == TileOrder::ROW ? REQUEST_ORDER_ROW : 0) |
+                (opts.Order == TileOrder::COLUMN ? REQUEST_ORDER_COLUMN : 0));
+  out.push_back((opts.MaxTiles ? REQUEST_MAX_TILES : 0) |
+                (opts.MaxError ? REQUEST_MAX_ERROR : 0) |
+                (opts.PaletteLines ? REQUEST_PALETTE_LINES : 0) |
+                (opts.Verify ? REQUEST_VERIFY : 0));
+  put_u32(out, (u32)opts.MaxTiles.value_or(0));
+  put_u32(out, (u32)std::lround(opts.MaxError.value_or(0) * 1000));
+  out.push_back((u8)opts.ChunkWidth);
+  out.push_back((u8)(opts.ChunkWidth >> 8));
+  out.push_back((u8)opts.ChunkHeight);
+  out.push_back((u8)(opts.ChunkHeight >> 8));
+  out.insert(out.end(), image.begin(), image.end());
+}
+
+void encode_response(std::vector<u8>& out, ConvertResponse const& response) {
+  out.clear();
+  out.insert(out.end(), RESPONSE_MAGIC,
+             RESPONSE_MAGIC + sizeof(RESPONSE_MAGIC));
+  out.push_back(response.Ok ? 0 : 1);
+  out.push_back(response.FromCache ? RESPONSE_FROM_CACHE : 0);
+  out.push_back(0);
+  out.push_back(0);
+  if (!response.Ok) {
+    put_u32(out, response.Error.size());
+    out.insert(out.end(), response.Error.begin(), response.Error.end());
+    return;
+  }
+  put_u64(out, response.Output->InputTiles);
+  put_u64(out, response.Output->OutputTiles);
+  put_blob(out, response.Output->Chr);
+  put_blob(out, response.Output->Map);
+  put_blob(out, response.Output->Pal);
+}
+
+ConvertResponse decode_response(std::vector<u8> const& payload) {
+  if (payload.size() < 12 ||
+      !std::equal(RESPONSE_MAGIC, RESPONSE_MAGIC + sizeof(RESPONSE_MAGIC),
+                  payload.begin())) {
+    throw std::runtime_error("Invalid response from server");
+  }
+  ConvertResponse response;
+  response.Ok = payload[8] == 0;
+  response.FromCache = payload[9] & RESPONSE_FROM_CACHE;
+
+  PayloadReader reader{payload, 12};
+  if (!response.Ok) {
+    std::vector<u8> message;
+    reader.get_blob(message);
+    response.Error.assign(message.begin(), message.end());
+    return response;
+  }
+  auto output{std::make_shared<ConvertOutput>()};
+  output->InputTiles = reader.get(8);
+  output->OutputTiles = reader.get(8);
+  reader.get_blob(output->Chr);
+  reader.get_blob(output->Map);
+  reader.get_blob(output->Pal);
+  response.Output = std::move(output);
+  return response;
+}
+
+// a read-only stream over bytes already in memory, so the PNG in a request
+// can be decoded without copying it
+class MemoryStreamBuf : public std::streambuf {
+ public:
+  MemoryStreamBuf(u8 const* data, size_t length) {
+    char* begin{(char*)data};
+    setg(begin, begin, begin + length);
+  }
+};
+
+/*
+  Recently converted images, held in memory and keyed like the build cache
+  Entries are shared, so a response can be sent while the entry is evicted.
+*/
+class ResultCache {
+ public:
+  explicit ResultCache(size_t max_size) : m_max_size{max_size} {}
+
+  std::shared_ptr<ConvertOutput const> find(std::string const& key) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto found{m_index.find(key)};
+    if (found == m_index.end()) {
+      return nullptr;
+    }
+    // move to the front as the most recently used
+    m_entries.splice(m_entries.begin(), m_entries, found->second);
+    return found->second->Output;
+  }
+
+  void insert(std::string const& key,
+              std::shared_ptr<ConvertOutput const> output) {
+    size_t const size{entry_size(*output)};
+    if (size > m_max_size) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock{m_mutex};
+    if (m_index.count(key) > 0) {
+      return;
+    }
+    m_entries.push_front(Entry{key, std::move(output), size});
+    m_index.emplace(key, m_entries.begin());
+    m_size += size;
+    while (m_size > m_max_size) {
+      m_size -= m_entries.back().Size;
+      m_index.erase(m_entries.back().Key);
+      m_entries.pop_back();
+    }
+  }
+
+ private:
+  struct Entry {
+    std::string Key;
+    std::shared_ptr<ConvertOutput const> Output;
+    size_t Size;
+  };
+
+  static size_t entry_size(ConvertOutput const& output) {
+    return output.Chr.size() + output.Map.size() + output.Pal.size();
+  }
+
+  std::mutex m_mutex;
+  std::list<Entry> m_entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+  size_t m_max_size;
+  size_t m_size{0};
+};
+
+// set by SIGINT/SIGTERM to shut the server down
+volatile std::sig_atomic_t server_stop{0};
+
+extern "C" void handle_server_signal(int) { server_stop = 1; }
+
+// answers one request, converting the image or taking it from the cache
+void handle_request(std::vector<u8> const& request, ConvertResponse& response,
+                    ThreadPool& pool, ResultCache& cache) {
+  response = ConvertResponse{};
+  try {
+    if (request.size() < REQUEST_HEADER_SIZE ||
+        !std::equal(REQUEST_MAGIC, REQUEST_MAGIC + sizeof(REQUEST_MAGIC),
+                    request.begin())) {
+      throw std::runtime_error("Invalid request");
+    }
+    u8 const flags{request[10]};
+    ConvertOptions opts;
+    opts.Base = (u16)(request[8] | (request[9] << 8)) & 0x1fff;
+    opts.MakePalette = flags & REQUEST_MAKE_PALETTE;
+    opts.NoMapOptimize = flags & REQUEST_NO_MAP_OPTIMIZE;
+    opts.Stream = flags & REQUEST_STREAM;
+    if (flags & REQUEST_ORDER_ROW) {
+      opts.Order = TileOrder::ROW;
+    } else if (flags & REQUEST_ORDER_COLUMN) {
+      opts.Order = TileOrder::COLUMN;
+    }
+    u8 const more_flags{request[11]};
+    PayloadReader settings{request, 12};
+    u32 const max_tiles{(u32)settings.get(4)};
+    u32 const max_error{(u32)settings.get(4)};
+    opts.ChunkWidth = settings.get(2);
+    opts.ChunkHeight = settings.get(2);
+    opts.PaletteLines = more_flags & REQUEST_PALETTE_LINES;
+    opts.Verify = more_flags & REQUEST_VERIFY;
+    if (more_flags & REQUEST_MAX_TILES) {
+      opts.MaxTiles = max_tiles;
+    }
+    if (more_flags & REQUEST_MAX_ERROR) {
+      opts.MaxError = max_error / 1000.0;
+    }
+
+    u8 const* image{request.data() + REQUEST_HEADER_SIZE};
+    size_t const image_size{request.size() - REQUEST_HEADER_SIZE};
+
+    std::string key;
+    if (!(flags & REQUEST_SKIP_CACHE)) {
+      ContentHash hash{cache_key_hash(opts)};
+      hash.update(image, image_size);
+      key = hash.hex();
+      if (auto cached{cache.find(key)}) {
+        response.Ok = true;
+        response.FromCache = true;
+        response.Output = std::move(cached);
+        return;
+      }
+    }
+
+    MemoryStreamBuf image_buf{image, image_size};
+    std::istream image_stream{&image_buf};
+    response.Output = std::make_shared<ConvertOutput const>(
+        convert_png(image_stream, opts, &pool));
+    response.Ok = true;
+    if (!key.empty()) {
+      cache.insert(key, response.Output);
+    }
+  } catch (std::exception const& e) {
+    response = ConvertResponse{};
+    response.Error = e.what();
+  }
+}
+
+/*
+  Runs the conversion server on a Unix domain socket until SIGINT or SIGTERM
+  Each connection is served by its own thread; conversions share one thread
+  pool and one cache of recent results, and each connection reuses its
+  message buffers from one request to the next.
+*/
+int run_server(std::string const& socket_path, unsigned int jobs,
+               size_t cache_max_size) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    throw std::invalid_argument("Socket path too long");
+  }
+  std::strcpy(addr.sun_path, socket_path.c_str());
+
+  int const listen_fd{::socket(AF_UNIX, SOCK_STREAM, 0)};
+  if (listen_fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  // a socket file left over from a previous run would block the bind
+  ::unlink(socket_path.c_str());
+  if (::bind(listen_fd, (sockaddr const*)&addr, sizeof(addr)) < 0 ||
+      ::listen(listen_fd, 16) < 0) {
+    int const error{errno};
+    ::close(listen_fd);
+    throw std::system_error(error, std::generic_category(),
+                            "Could not listen on " + socket_path);
+  }
+
+  std::signal(SIGINT, handle_server_signal);
+  std::signal(SIGTERM, handle_server_signal);
+
+  ThreadPool pool{jobs};
+  ResultCache cache{cache_max_size};
+
+  struct connection {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> done{false};
+  };
+  std::list<connection> connections;
+
+  std::cout << "Listening on " << socket_path << " (" << pool.size()
+            << " threads)" << std::endl;
+
+  while (!server_stop) {
+    // clean up after connections that have closed
+    connections.remove_if([](connection& this_conn) {
+      if (!this_conn.done) {
+        return false;
+      }
+      this_conn.thread.join();
+      ::close(this_conn.fd);
+      return true;
+    });
+
+    // wake up regularly to check for a shutdown signal
+    pollfd listen_poll{listen_fd, POLLIN, 0};
+    if (::poll(&listen_poll, 1, 250) <= 0) {
+      continue;
+    }
+    int const client_fd{::accept(listen_fd, nullptr, nullptr)};
+    if (client_fd < 0) {
+      continue;
+    }
+
+    auto& this_conn{connections.emplace_back()};
+    this_conn.fd = client_fd;
+    this_conn.thread = std::thread{[&this_conn, &pool, &cache] {
+      std::vector<u8> request, response_payload;
+      ConvertResponse response;
+      try {
+        while (read_frame(this_conn.fd, request)) {
+          handle_request(request, response, pool, cache);
+          encode_response(response_payload, response);
+          write_frame(this_conn.fd, response_payload);
+        }
+      } catch (std::exception const& e) {
+        // only this connection is affected
+        std::cerr << "Connection error: " << e.what() << std::endl;
+      }
+      // the socket is closed once the thread has been joined
+      this_conn.done = true;
+    }};
+  }
+
+  std::cout << "Shutting down" << std::endl;
+  ::close(listen_fd);
+  ::unlink(socket_path.c_str());
+  for (auto& this_conn : connections) {
+    // unblock any thread waiting for its next request
+    ::shutdown(this_conn.fd, SHUT_RDWR);
+    this_conn.thread.join();
+    ::close(this_conn.fd);
+  }
+
+  return 0;
+}
+
+#endif